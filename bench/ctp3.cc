@@ -0,0 +1,149 @@
+#include <iostream>
+#include <vector>
+#include <fstream>
+
+#include "../ctp3/ctp3.h"
+#include <benchmark.h>
+
+using namespace std;
+
+// Microbenchmarks for next(), sample() and hash_t::bestQValue() in ctp3,
+// and for the graph searches (Dijkstra and A*) and all-pairs distances
+// (Floyd-Warshall) run from the states of the collected pairs.
+
+struct dijkstra_functor_t {
+    const CTP::graph_t &graph_;
+    const vector<pair<state_t, Problem::action_t> > &pairs_;
+    vector<int> distances_;
+    Benchmark::sink_t sink_;
+    dijkstra_functor_t(const CTP::graph_t &graph, const vector<pair<state_t, Problem::action_t> > &pairs)
+      : graph_(graph), pairs_(pairs), distances_(graph.num_nodes_) { }
+    void operator()() {
+        for( size_t i = 0, isz = pairs_.size(); i < isz; ++i ) {
+            const state_t &s = pairs_[i].first;
+            graph_.dijkstra(s.current_ == -1 ? 0 : s.current_, &distances_[0], s.info_.known_.words_, s.info_.blocked_.words_, false);
+            sink_.consume(distances_[graph_.num_nodes_ - 1]);
+        }
+    }
+};
+
+struct bfs_functor_t {
+    const CTP::graph_t &graph_;
+    const vector<pair<state_t, Problem::action_t> > &pairs_;
+    Benchmark::sink_t sink_;
+    bfs_functor_t(const CTP::graph_t &graph, const vector<pair<state_t, Problem::action_t> > &pairs)
+      : graph_(graph), pairs_(pairs) { }
+    void operator()() {
+        for( size_t i = 0, isz = pairs_.size(); i < isz; ++i ) {
+            const state_t &s = pairs_[i].first;
+            sink_.consume(graph_.bfs(s.current_ == -1 ? 0 : s.current_, graph_.num_nodes_ - 1, s.info_.known_.words_, s.info_.blocked_.words_, true));
+        }
+    }
+};
+
+struct floyd_warshall_functor_t {
+    const CTP::graph_t &graph_;
+    const vector<pair<state_t, Problem::action_t> > &pairs_;
+    size_t npairs_;
+    vector<int> distances_;
+    Benchmark::sink_t sink_;
+    floyd_warshall_functor_t(const CTP::graph_t &graph, const vector<pair<state_t, Problem::action_t> > &pairs, size_t npairs)
+      : graph_(graph), pairs_(pairs), npairs_(npairs), distances_(graph.num_nodes_ * graph.num_nodes_) { }
+    void operator()() {
+        for( size_t i = 0; i < npairs_; ++i ) {
+            const state_t &s = pairs_[i].first;
+            graph_.floyd_warshall(&distances_[0], s.info_.known_.words_, s.info_.blocked_.words_, true);
+            sink_.consume(distances_[graph_.num_nodes_ - 1]);
+        }
+    }
+};
+
+void usage(ostream &os) {
+    os << "usage: ctp3 [-c <n>] [-n <n>] [-r <n>] [-s <n>] <file>"
+       << endl << endl
+       << "  -c <n>    Capacity of cache for shortest-path distances. Default: 0."
+       << endl
+       << "  -n <n>    Number of (state,action) pairs. Default: 10000."
+       << endl
+       << "  -r <n>    Repetitions per benchmark. Default: 10."
+       << endl
+       << "  -s <n>    Random seed. Default: 0."
+       << endl
+       << "  <file>    Graph file (text or binary)."
+       << endl << endl;
+}
+
+int main(int argc, const char **argv) {
+    CTP::graph_t graph;
+    bool parsed = false;
+    size_t npairs = 10000;
+    unsigned repetitions = 10;
+    unsigned long seed = 0;
+    unsigned distances_cache = 0;
+
+    // parse arguments
+    ++argv;
+    --argc;
+    while( argc > 1 ) {
+        if( **argv != '-' ) break;
+        switch( (*argv)[1] ) {
+            case 'c':
+                distances_cache = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'n':
+                npairs = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'r':
+                repetitions = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 's':
+                seed = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            default:
+                usage(cout);
+                exit(-1);
+        }
+    }
+
+    if( argc >= 1 ) {
+        parsed = graph.load(argv[0]);
+    } else {
+        usage(cout);
+        exit(-1);
+    }
+
+    // build problem instance
+    cout << "seed=" << seed << endl;
+    Random::set_seed(seed);
+    if( !parsed ) exit(-1);
+    context_t context(graph, distances_cache > 0, distances_cache);
+    if( !context.check(cout) ) exit(-1);
+    problem_t problem(context);
+
+    Benchmark::problem_suite(cout, "ctp3", problem, npairs, repetitions);
+    context.print_stats(cout);
+
+    vector<pair<state_t, Problem::action_t> > pairs;
+    Benchmark::collect_pairs(problem, npairs, 1000, pairs);
+    if( pairs.empty() ) exit(0);
+    dijkstra_functor_t dijkstra(graph, pairs);
+    Benchmark::run(cout, "ctp3::graph_t::dijkstra()", dijkstra, pairs.size(), repetitions);
+    bfs_functor_t bfs(graph, pairs);
+    Benchmark::run(cout, "ctp3::graph_t::bfs()", bfs, pairs.size(), repetitions);
+    if( graph.has_all_pairs() ) {
+        size_t nmatrices = pairs.size() < 100 ? pairs.size() : 100;
+        floyd_warshall_functor_t floyd_warshall(graph, pairs, nmatrices);
+        Benchmark::run(cout, "ctp3::graph_t::floyd_warshall()", floyd_warshall, nmatrices, repetitions);
+    }
+
+    exit(0);
+}
+
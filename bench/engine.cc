@@ -0,0 +1,207 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <queue>
+
+#include <benchmark.h>
+#include <aot.h>
+
+using namespace std;
+
+// Microbenchmarks for engine data structures that do not depend on a
+// particular domain: hash_map_t, the priority queues used by AOT, and
+// the random number generator.
+
+void usage(ostream &os) {
+    os << "usage: engine [-r <n>] [-s <n>]"
+       << endl << endl
+       << "  -r <n>    Repetitions per benchmark. Default: 10."
+       << endl
+       << "  -s <n>    Random seed. Default: 0."
+       << endl << endl;
+}
+
+// simple state type for hash tables
+class int_state_t {
+    unsigned key_;
+  public:
+    int_state_t(unsigned key = 0) : key_(key) { }
+    size_t hash() const { return key_; }
+    bool operator==(const int_state_t &k) const { return key_ == k.key_; }
+    bool operator!=(const int_state_t &k) const { return key_ != k.key_; }
+    void print(std::ostream &os) const { os << key_; }
+};
+
+inline std::ostream& operator<<(std::ostream &os, const int_state_t &k) {
+    k.print(os);
+    return os;
+}
+
+// scrambles keys so that consecutive integers do not hash to consecutive buckets
+inline unsigned scramble(unsigned i) {
+    return i * 2654435761U;
+}
+
+struct hash_insert_t {
+    size_t size_;
+    Benchmark::sink_t sink_;
+    hash_insert_t(size_t size) : size_(size) { }
+    void operator()() {
+        Hash::hash_map_t<int_state_t> *table = new Hash::hash_map_t<int_state_t>;
+        for( size_t i = 0; i < size_; ++i )
+            table->update(int_state_t(scramble(i << 1)), i);
+        sink_.consume(table->size());
+        delete table;
+    }
+};
+
+struct hash_lookup_t {
+    const Hash::hash_map_t<int_state_t> &table_;
+    vector<int_state_t> queries_;
+    Benchmark::sink_t sink_;
+    hash_lookup_t(const Hash::hash_map_t<int_state_t> &table, size_t size, size_t nqueries, float hit_rate)
+      : table_(table) {
+        queries_.reserve(nqueries);
+        for( size_t i = 0; i < nqueries; ++i ) {
+            unsigned k = Random::uniform(size) << 1;
+            if( Random::real() >= hit_rate ) ++k; // odd keys are never stored
+            queries_.push_back(int_state_t(scramble(k)));
+        }
+    }
+    void operator()() {
+        for( size_t i = 0, isz = queries_.size(); i < isz; ++i )
+            sink_.consume(table_.value(queries_[i]));
+    }
+};
+
+// dummy AOT node to exercise the priority queues with the real comparators
+struct node_t : public Online::Policy::AOT::node_t<int_state_t> {
+    node_t(float delta = 0) : Online::Policy::AOT::node_t<int_state_t>(0, delta) { }
+    virtual ~node_t() { }
+    virtual void print(std::ostream &os, bool indent = true) const { }
+    virtual void expand(const Online::Policy::AOT::aot_t<int_state_t> *policy,
+                        std::vector<Online::Policy::AOT::node_t<int_state_t>*> &nodes_to_propagate) { }
+    virtual void propagate(const Online::Policy::AOT::aot_t<int_state_t> *policy) { }
+};
+
+struct std_pq_t {
+    vector<node_t> &nodes_;
+    Benchmark::sink_t sink_;
+    std_pq_t(vector<node_t> &nodes) : nodes_(nodes) { }
+    void operator()() {
+        Online::Policy::AOT::priority_queue_t<int_state_t> pq;
+        for( size_t i = 0, isz = nodes_.size(); i < isz; ++i )
+            pq.push(&nodes_[i]);
+        while( !pq.empty() ) {
+            sink_.consume(pq.top()->delta_);
+            pq.pop();
+        }
+    }
+};
+
+struct bdd_pq_t {
+    vector<node_t> &nodes_;
+    unsigned capacity_;
+    Benchmark::sink_t sink_;
+    bdd_pq_t(vector<node_t> &nodes, unsigned capacity) : nodes_(nodes), capacity_(capacity) { }
+    void operator()() {
+        Online::Policy::AOT::bdd_priority_queue_t<int_state_t> pq(capacity_);
+        for( size_t i = 0, isz = nodes_.size(); i < isz; ++i ) {
+            Online::Policy::AOT::node_t<int_state_t> *node = &nodes_[i];
+            pq.push(node);
+        }
+        while( !pq.empty() ) {
+            sink_.consume(pq.top()->delta_);
+            pq.pop();
+        }
+    }
+};
+
+struct random_real_t {
+    size_t n_;
+    Benchmark::sink_t sink_;
+    random_real_t(size_t n) : n_(n) { }
+    void operator()() {
+        float sum = 0;
+        for( size_t i = 0; i < n_; ++i )
+            sum += Random::real();
+        sink_.consume(sum);
+    }
+};
+
+int main(int argc, const char **argv) {
+    unsigned repetitions = 10;
+    unsigned long seed = 0;
+
+    // parse arguments
+    ++argv;
+    --argc;
+    while( argc > 0 ) {
+        if( **argv != '-' ) break;
+        switch( (*argv)[1] ) {
+            case 'r':
+                repetitions = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 's':
+                seed = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            default:
+                usage(cout);
+                exit(-1);
+        }
+    }
+
+    cout << "seed=" << seed << endl;
+    Random::set_seed(seed);
+
+    // hash_map_t: insertion and lookup at varying sizes and hit rates
+    size_t nqueries = 100000;
+    for( size_t size = 1000; size <= 1000000; size *= 10 ) {
+        stringstream name;
+        name << "hash_map_t::insert(size=" << size << ")";
+        hash_insert_t insert(size);
+        Benchmark::run(cout, name.str(), insert, size, repetitions);
+
+        Hash::hash_map_t<int_state_t> table;
+        for( size_t i = 0; i < size; ++i )
+            table.update(int_state_t(scramble(i << 1)), i);
+        for( int h = 0; h <= 2; ++h ) {
+            float hit_rate = .5 * h;
+            stringstream name;
+            name << "hash_map_t::value(size=" << size << ",hit=" << hit_rate << ")";
+            hash_lookup_t lookup(table, size, nqueries, hit_rate);
+            Benchmark::run(cout, name.str(), lookup, nqueries, repetitions);
+        }
+    }
+
+    // priority queues used by AOT (see USE_BDD_PQ in aot.h)
+    for( size_t n = 100; n <= 100000; n *= 10 ) {
+        vector<node_t> nodes;
+        nodes.reserve(n);
+        for( size_t i = 0; i < n; ++i )
+            nodes.push_back(node_t(Random::real() - .5));
+
+        stringstream name;
+        name << "std::priority_queue(n=" << n << ")";
+        std_pq_t std_pq(nodes);
+        Benchmark::run(cout, name.str(), std_pq, n, repetitions);
+
+        for( unsigned capacity = 10; capacity <= n; capacity *= 10 ) {
+            stringstream name;
+            name << "std::bdd_priority_queue(n=" << n << ",cap=" << capacity << ")";
+            bdd_pq_t bdd_pq(nodes, capacity);
+            Benchmark::run(cout, name.str(), bdd_pq, n, repetitions);
+        }
+    }
+
+    // random numbers
+    random_real_t real(1000000);
+    Benchmark::run(cout, "Random::real()", real, 1000000, repetitions);
+
+    exit(0);
+}
+
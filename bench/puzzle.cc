@@ -0,0 +1,87 @@
+#include <iostream>
+#include <vector>
+
+#include "../puzzle/puzzle.h"
+#include <benchmark.h>
+
+using namespace std;
+
+// Microbenchmarks for next(), sample() and hash_t::bestQValue() in puzzle.
+
+void usage(ostream &os) {
+    os << "usage: puzzle [-n <n>] [-r <n>] [-s <n>] [-p <f>] <rows> <cols>"
+       << endl << endl
+       << "  -p <f>    Parameter p in [0,1]. Default: 1."
+       << endl
+       << "  -n <n>    Number of (state,action) pairs. Default: 10000."
+       << endl
+       << "  -r <n>    Repetitions per benchmark. Default: 10."
+       << endl
+       << "  -s <n>    Random seed. Default: 0."
+       << endl
+       << "  <rows>    Number of rows."
+       << endl
+       << "  <cols>    Number of cols."
+       << endl << endl;
+}
+
+int main(int argc, const char **argv) {
+    unsigned rows = 0, cols = 0;
+    float p = 1.0;
+    size_t npairs = 10000;
+    unsigned repetitions = 10;
+    unsigned long seed = 0;
+
+    // parse arguments
+    ++argv;
+    --argc;
+    while( argc > 1 ) {
+        if( **argv != '-' ) break;
+        switch( (*argv)[1] ) {
+            case 'p':
+                p = strtod(argv[1], 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'n':
+                npairs = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'r':
+                repetitions = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 's':
+                seed = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            default:
+                usage(cout);
+                exit(-1);
+        }
+    }
+
+    if( argc >= 2 ) {
+        rows = strtoul(argv[0], 0, 0);
+        cols = strtoul(argv[1], 0, 0);
+    } else {
+        usage(cout);
+        exit(-1);
+    }
+
+    // build problem instance
+    cout << "seed=" << seed << endl;
+    Random::set_seed(seed);
+    state_t init;
+    init.set_goal(rows, cols);
+    init.random_moves(rows, cols, 500);
+    problem_t problem(rows, cols, init, p);
+
+    Benchmark::problem_suite(cout, "puzzle", problem, npairs, repetitions);
+
+    exit(0);
+}
+
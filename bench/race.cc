@@ -0,0 +1,84 @@
+#include <iostream>
+#include <vector>
+
+#include "../race/race.h"
+#include <benchmark.h>
+
+using namespace std;
+
+// Microbenchmarks for next(), sample() and hash_t::bestQValue() in race.
+
+void usage(ostream &os) {
+    os << "usage: race [-n <n>] [-r <n>] [-s <n>] [-p <f>] <file>"
+       << endl << endl
+       << "  -p <f>    Parameter p in [0,1]. Default: 1."
+       << endl
+       << "  -n <n>    Number of (state,action) pairs. Default: 10000."
+       << endl
+       << "  -r <n>    Repetitions per benchmark. Default: 10."
+       << endl
+       << "  -s <n>    Random seed. Default: 0."
+       << endl
+       << "  <file>    Racetrack file."
+       << endl << endl;
+}
+
+int main(int argc, const char **argv) {
+    float p = 1.0;
+    FILE *is = 0;
+    size_t npairs = 10000;
+    unsigned repetitions = 10;
+    unsigned long seed = 0;
+
+    // parse arguments
+    ++argv;
+    --argc;
+    while( argc > 1 ) {
+        if( **argv != '-' ) break;
+        switch( (*argv)[1] ) {
+            case 'p':
+                p = strtod(argv[1], 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'n':
+                npairs = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'r':
+                repetitions = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 's':
+                seed = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            default:
+                usage(cout);
+                exit(-1);
+        }
+    }
+
+    if( argc >= 1 ) {
+        is = fopen(argv[0], "r");
+    } else {
+        usage(cout);
+        exit(-1);
+    }
+
+    // build problem instance
+    cout << "seed=" << seed << endl;
+    Random::set_seed(seed);
+    grid_t grid;
+    grid.parse(cout, is);
+    problem_t problem(grid, p);
+    fclose(is);
+
+    Benchmark::problem_suite(cout, "race", problem, npairs, repetitions);
+
+    exit(0);
+}
+
@@ -0,0 +1,74 @@
+#include <iostream>
+#include <vector>
+
+#include <dispatcher.h>
+#include "../sailing/sailing.h"
+#include <benchmark.h>
+
+using namespace std;
+
+// Microbenchmarks for next(), sample() and hash_t::bestQValue() in sailing.
+
+void usage(ostream &os) {
+    os << "usage: sailing [-n <n>] [-r <n>] [-s <n>] <dim>"
+       << endl << endl
+       << "  -n <n>    Number of (state,action) pairs. Default: 10000."
+       << endl
+       << "  -r <n>    Repetitions per benchmark. Default: 10."
+       << endl
+       << "  -s <n>    Random seed. Default: 0."
+       << endl
+       << "  <dim>     Dimension for rows and cols <= 2^16."
+       << endl << endl;
+}
+
+int main(int argc, const char **argv) {
+    unsigned dim = 0;
+    size_t npairs = 10000;
+    unsigned repetitions = 10;
+    unsigned long seed = 0;
+
+    // parse arguments
+    ++argv;
+    --argc;
+    while( argc > 1 ) {
+        if( **argv != '-' ) break;
+        switch( (*argv)[1] ) {
+            case 'n':
+                npairs = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'r':
+                repetitions = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 's':
+                seed = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            default:
+                usage(cout);
+                exit(-1);
+        }
+    }
+
+    if( argc >= 1 ) {
+        dim = strtoul(argv[0], 0, 0);
+    } else {
+        usage(cout);
+        exit(-1);
+    }
+
+    // build problem instance
+    cout << "seed=" << seed << endl;
+    Random::set_seed(seed);
+    problem_t problem(dim, dim);
+
+    Benchmark::problem_suite(cout, "sailing", problem, npairs, repetitions);
+
+    exit(0);
+}
+
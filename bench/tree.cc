@@ -0,0 +1,95 @@
+#include <iostream>
+#include <vector>
+
+#include "../tree/tree.h"
+#include <benchmark.h>
+
+using namespace std;
+
+// Microbenchmarks for next(), sample() and hash_t::bestQValue() in tree.
+
+void usage(ostream &os) {
+    os << "usage: tree [-n <n>] [-r <n>] [-s <n>] [-p <f>] [-q <f>] [-r <f>] <size>"
+       << endl << endl
+       << "  -p <f>    Parameter p in [0,1]. Default: 0."
+       << endl
+       << "  -q <f>    Parameter q in [0,1]. Default: 0."
+       << endl
+       << "  -R <f>    Parameter r in [0,1]. Default: 0."
+       << endl
+       << "  -n <n>    Number of (state,action) pairs. Default: 10000."
+       << endl
+       << "  -r <n>    Repetitions per benchmark. Default: 10."
+       << endl
+       << "  -s <n>    Random seed. Default: 0."
+       << endl
+       << "  <size>    Size of tree."
+       << endl << endl;
+}
+
+int main(int argc, const char **argv) {
+    unsigned size = 0;
+    float p = 0.0, q = 0.0, r = 0.0;
+    size_t npairs = 10000;
+    unsigned repetitions = 10;
+    unsigned long seed = 0;
+
+    // parse arguments
+    ++argv;
+    --argc;
+    while( argc > 1 ) {
+        if( **argv != '-' ) break;
+        switch( (*argv)[1] ) {
+            case 'p':
+                p = strtod(argv[1], 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'q':
+                q = strtod(argv[1], 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'R':
+                r = strtod(argv[1], 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'n':
+                npairs = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'r':
+                repetitions = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 's':
+                seed = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            default:
+                usage(cout);
+                exit(-1);
+        }
+    }
+
+    if( argc >= 1 ) {
+        size = strtoul(argv[0], 0, 0);
+    } else {
+        usage(cout);
+        exit(-1);
+    }
+
+    // build problem instance
+    cout << "seed=" << seed << endl;
+    Random::set_seed(seed);
+    problem_t problem(size, p, q, r);
+
+    Benchmark::problem_suite(cout, "tree", problem, npairs, repetitions);
+
+    exit(0);
+}
+
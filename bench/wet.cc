@@ -0,0 +1,83 @@
+#include <iostream>
+#include <vector>
+
+#include "../wet/wet.h"
+#include <benchmark.h>
+
+using namespace std;
+
+// Microbenchmarks for next(), sample() and hash_t::bestQValue() in wet.
+
+void usage(ostream &os) {
+    os << "usage: wet [-n <n>] [-r <n>] [-s <n>] [-p <f>] <size>"
+       << endl << endl
+       << "  -p <f>    Probability of water. Default: 0."
+       << endl
+       << "  -n <n>    Number of (state,action) pairs. Default: 10000."
+       << endl
+       << "  -r <n>    Repetitions per benchmark. Default: 10."
+       << endl
+       << "  -s <n>    Random seed. Default: 0."
+       << endl
+       << "  <size>    Size of grid."
+       << endl << endl;
+}
+
+int main(int argc, const char **argv) {
+    unsigned size = 0;
+    float p = 0.0;
+    size_t npairs = 10000;
+    unsigned repetitions = 10;
+    unsigned long seed = 0;
+
+    // parse arguments
+    ++argv;
+    --argc;
+    while( argc > 1 ) {
+        if( **argv != '-' ) break;
+        switch( (*argv)[1] ) {
+            case 'p':
+                p = strtod(argv[1], 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'n':
+                npairs = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'r':
+                repetitions = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 's':
+                seed = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            default:
+                usage(cout);
+                exit(-1);
+        }
+    }
+
+    if( argc >= 1 ) {
+        size = strtoul(argv[0], 0, 0);
+    } else {
+        usage(cout);
+        exit(-1);
+    }
+
+    // build problem instance
+    cout << "seed=" << seed << endl;
+    Random::set_seed(seed);
+    state_t init(Random::uniform(size), Random::uniform(size));
+    state_t goal(Random::uniform(size), Random::uniform(size));
+    problem_t problem(size, p, init, goal);
+
+    Benchmark::problem_suite(cout, "wet", problem, npairs, repetitions);
+
+    exit(0);
+}
+
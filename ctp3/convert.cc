@@ -0,0 +1,74 @@
+#include <iostream>
+#include <fstream>
+
+#include "graph.h"
+
+using namespace std;
+
+// Converts CTP graph files between the text and binary formats. The
+// input format is detected; the output is binary unless -t is given.
+
+void usage(ostream &os) {
+    os << "usage: convert [-t] <input> <output>"
+       << endl << endl
+       << "  -t        Write text format. Default: binary."
+       << endl
+       << "  <input>   Graph file (text or binary)."
+       << endl
+       << "  <output>  Converted graph file."
+       << endl << endl;
+}
+
+int main(int argc, const char **argv) {
+    bool text = false;
+
+    // parse arguments
+    ++argv;
+    --argc;
+    while( argc > 2 ) {
+        if( **argv != '-' ) break;
+        switch( (*argv)[1] ) {
+            case 't':
+                text = true;
+                ++argv;
+                --argc;
+                break;
+            default:
+                usage(cout);
+                exit(-1);
+        }
+    }
+
+    if( argc != 2 ) {
+        usage(cout);
+        exit(-1);
+    }
+
+    CTP::graph_t graph;
+    if( CTP::graph_t::is_binary(argv[0]) ) {
+        if( !graph.read_binary(argv[0]) ) exit(-1);
+    } else {
+        ifstream is(argv[0], ifstream::in);
+        if( !graph.read_text(is) ) exit(-1);
+    }
+
+    bool written = false;
+    if( text ) {
+        ofstream os(argv[1], ofstream::out);
+        graph.write_text(os);
+        written = os.good();
+    } else {
+        written = graph.write_binary(argv[1]);
+    }
+    if( !written ) {
+        cout << "error: cannot write '" << argv[1] << "'" << endl;
+        exit(-1);
+    }
+    cout << "info: #nodes=" << graph.num_nodes_
+         << ", #edges=" << graph.num_edges_
+         << ", format=" << (text ? "text" : "binary")
+         << endl;
+
+    exit(0);
+}
+
@@ -1,7 +1,10 @@
+#include <atomic>
 #include <cassert>
 #include <cstring>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <new>
 #include <vector>
 #include <limits.h>
 #include <unordered_map>
@@ -17,8 +20,14 @@
 
 #define DISCOUNT 1.00
 
-#define WORDS_FOR_NODES 4 // max. 128 nodes
-#define WORDS_FOR_EDGES 9 // max. 288 edges
+// Capacity of states; larger graphs need a build with, e.g.,
+// -DCTP_MAX_NODES=512 -DCTP_MAX_EDGES=2048 (see makefile)
+#ifndef CTP_MAX_NODES
+#define CTP_MAX_NODES 128
+#endif
+#ifndef CTP_MAX_EDGES
+#define CTP_MAX_EDGES 320
+#endif
 
 
 inline unsigned rotation(unsigned x) {
@@ -48,290 +57,728 @@ template<typename T> inline std::ostream& operator<<(std::ostream &os, const pri
 }
 
 
+// Set of N bits in 64-bit words. The capacity is fixed at compile time,
+// so copies, comparisons and the XOR fold are loops of constant length
+// that the compiler unrolls and vectorizes. Words have the layout of the
+// edge bitmaps of CTP::graph_t.
+template<int N> struct bitset_t {
+    enum { num_words = (N + 63) >> 6 };
+    CTP::word_t words_[num_words];
 
-struct state_info_t {
-    unsigned known_[WORDS_FOR_EDGES];
-    unsigned blocked_[WORDS_FOR_EDGES];
-    static int words_for_edges_;
+    bitset_t() { clear(); }
+
+    void clear() {
+        memset(words_, 0, sizeof(words_));
+    }
+    bool test(int i) const {
+        return ((words_[i >> 6] >> (i & 0x3F)) & 1) != 0;
+    }
+    void set(int i) {
+        words_[i >> 6] |= CTP::word_t(1) << (i & 0x3F);
+    }
+    void reset(int i) {
+        words_[i >> 6] &= ~(CTP::word_t(1) << (i & 0x3F));
+    }
+
+    // XOR of all words folded into 32 bits
+    unsigned fold() const {
+        CTP::word_t x = 0;
+        for( int i = 0; i < num_words; ++i )
+            x ^= words_[i];
+        return (unsigned)x ^ (unsigned)(x >> 32);
+    }
 
-    state_info_t() {
-        memset(known_, 0, WORDS_FOR_EDGES * sizeof(unsigned));
-        memset(blocked_, 0, WORDS_FOR_EDGES * sizeof(unsigned));
+    bool operator==(const bitset_t &bits) const {
+        CTP::word_t diff = 0;
+        for( int i = 0; i < num_words; ++i )
+            diff |= words_[i] ^ bits.words_[i];
+        return diff == 0;
+    }
+    bool operator!=(const bitset_t &bits) const {
+        return *this == bits ? false : true;
+    }
+    // bytewise order, as with the previous arrays of 32-bit words
+    int compare(const bitset_t &bits) const {
+        return memcmp(words_, bits.words_, sizeof(words_));
     }
-    ~state_info_t() { }
 
-    static void initialize(int words_for_edges) {
-        words_for_edges_ = words_for_edges;
+    void print(std::ostream &os) const {
+        for( int i = 0; i < num_words; ++i )
+            os << print_bits_t<CTP::word_t>(words_[i], i << 6);
+    }
+};
+
+
+struct state_info_t {
+    bitset_t<CTP_MAX_EDGES> known_;
+    bitset_t<CTP_MAX_EDGES> blocked_;
+
+    state_info_t() { }
+
+    // makes the edges in bits known and blocked, and all others unknown
+    void assign_blocked(const bitset_t<CTP_MAX_EDGES> &bits) {
+        known_ = bits;
+        blocked_ = bits;
     }
 
     size_t hash() const {
-        unsigned rv = 0;
-        for( int i = 0; i < words_for_edges_; ++i )
-            rv = rv ^ known_[i];
-        for( int i = 0; i < words_for_edges_; ++i )
-            rv = rv ^ rotation(blocked_[i]);
-        return rv;
+        return known_.fold() ^ rotation(blocked_.fold());
     }
 
     void clear() {
-        memset(known_, 0, words_for_edges_ * sizeof(unsigned));
-        memset(blocked_, 0, words_for_edges_ * sizeof(unsigned));
+        known_.clear();
+        blocked_.clear();
     }
 
     bool known(int edge) const {
-        int n = edge >> 5, offset = edge & 0x1F;
-        int mask = 1 << offset;
-        return known_[n] & mask;
+        return known_.test(edge);
     }
     bool traversable(int edge) const {
-        int n = edge >> 5, offset = edge & 0x1F;
-        int mask = 1 << offset;
-        return (blocked_[n] & mask) != 0 ? false : true;
+        return !blocked_.test(edge);
     }
     void set_edge_status(int edge, bool blocked) {
-        int n = edge >> 5, offset = edge & 0x1F;
-        int mask = 1 << offset;
-        known_[n] |= mask;
+        known_.set(edge);
         if( blocked )
-            blocked_[n] |= mask;
+            blocked_.set(edge);
         else
-            blocked_[n] &= ~mask;
-    }
-
-    const state_info_t& operator=(const state_info_t &info) {
-        memcpy(known_, info.known_, words_for_edges_ * sizeof(unsigned));
-        memcpy(blocked_, info.blocked_, words_for_edges_ * sizeof(unsigned));
-        return *this;
+            blocked_.reset(edge);
     }
 
     bool operator==(const state_info_t &info) const {
-        return (memcmp(known_, info.known_, words_for_edges_ * sizeof(unsigned)) == 0) &&
-               (memcmp(blocked_, info.blocked_, words_for_edges_ * sizeof(unsigned)) == 0);
+        return (known_ == info.known_) && (blocked_ == info.blocked_);
     }
     bool operator!=(const state_info_t &info) const {
         return *this == info ? false : true;
     }
     bool operator<(const state_info_t &info) const {
-        return (memcmp(known_, info.known_, words_for_edges_ * sizeof(unsigned)) < 0) ||
-               ((memcmp(known_, info.known_, words_for_edges_ * sizeof(unsigned)) == 0) &&
-                (memcmp(blocked_, info.blocked_, words_for_edges_ * sizeof(unsigned)) < 0));
+        int c = known_.compare(info.known_);
+        return (c < 0) || ((c == 0) && (blocked_.compare(info.blocked_) < 0));
     }
 
     void print(std::ostream &os) const {
         os << "K={";
-        for( int i = 0; i < words_for_edges_; ++i )
-            os << print_bits_t<unsigned>(known_[i], i << 5);
+        known_.print(os);
         os << "},B={";
-        for( int i = 0; i < words_for_edges_; ++i )
-            os << print_bits_t<unsigned>(blocked_[i], i << 5);
+        blocked_.print(os);
         os << "}";
     }
 };
 
-int state_info_t::words_for_edges_ = 0;
-
 inline std::ostream& operator<<(std::ostream &os, const state_info_t &info) {
     info.print(os);
     return os;
 }
 
+// Shortest-path distances from a node under given edge information.
+// Arrays are reference counted: copies of states share them, and the
+// shortest-path cache holds one reference for each of its slots. The
+// count is atomic so that states can be shared by concurrent planners.
+class distances_t {
+    std::atomic<unsigned> refs_;
+    distances_t() : refs_(1) { }
+    ~distances_t() { }
+    friend class shortest_path_cache_t;
+
+  public:
+    static size_t size(int num_nodes) {
+        return sizeof(distances_t) + num_nodes * sizeof(int);
+    }
+    static distances_t* allocate(int num_nodes) {
+        void *mem = ::operator new(size(num_nodes));
+        return new(mem) distances_t;
+    }
+    static distances_t* acquire(distances_t *d) {
+        if( d != 0 ) d->refs_.fetch_add(1, std::memory_order_relaxed);
+        return d;
+    }
+    static void release(distances_t *d) {
+        if( (d != 0) && (d->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) ) {
+            d->~distances_t();
+            ::operator delete(d);
+        }
+    }
+    unsigned references() const { return refs_.load(std::memory_order_acquire); }
+
+    int* values() { return reinterpret_cast<int*>(this + 1); }
+    const int* values() const { return reinterpret_cast<const int*>(this + 1); }
+    int operator[](int node) const { return values()[node]; }
+};
+
+struct shortest_path_key_t {
+    int source_;
+    state_info_t info_;
+    shortest_path_key_t() : source_(-1) { }
+    shortest_path_key_t(int source, const state_info_t &info)
+      : source_(source) {
+        info_ = info;
+    }
+    bool operator==(const shortest_path_key_t &key) const {
+        return (source_ == key.source_) && (info_ == key.info_);
+    }
+    size_t hash() const {
+        return info_.hash() ^ ((size_t)source_ * 0x9e3779b9);
+    }
+};
+
 struct cache_functions_t {
-    bool operator()(const state_info_t &info1, const state_info_t &info2) const {
-        return info1 == info2;
+    bool operator()(const shortest_path_key_t &key1, const shortest_path_key_t &key2) const {
+        return key1 == key2;
     }
-    size_t operator()(const state_info_t &info) const {
-        return info.hash();
+    size_t operator()(const shortest_path_key_t &key) const {
+        return key.hash();
     }
 };
 
-class shortest_path_cache_item_t
-  : public std::unordered_map<state_info_t, int*, cache_functions_t, cache_functions_t> {
-  public:
-    void clear() {
-        for( iterator it = begin(); it != end(); ++it )
-            delete[] it->second;
-        std::unordered_map<state_info_t, int*, cache_functions_t, cache_functions_t>::clear();
+// Computes the distances from a source under given edge information.
+struct dijkstra_t {
+    const CTP::graph_t &graph_;
+    int source_;
+    const state_info_t &info_;
+    bool optimistic_;
+    dijkstra_t(const CTP::graph_t &graph, int source, const state_info_t &info, bool optimistic)
+      : graph_(graph), source_(source), info_(info), optimistic_(optimistic) { }
+    void operator()(distances_t *distances) const {
+        graph_.dijkstra(source_, distances->values(), info_.known_.words_, info_.blocked_.words_, optimistic_);
     }
+};
 
-    void print_stats(std::ostream &os) const {
-        int maxsz = 0;
-        for( int i = 0; i < (int)bucket_count(); ++i ) {
-            int sz = bucket_size(i);
-            maxsz = sz > maxsz ? sz : maxsz;
-        }
-        os << "#entries=" << size()
-           << ", #buckets=" << bucket_count()
-           << ", max-bucket-size=" << maxsz;
+// Computes distances by repairing those of a parent after some edges
+// turned out to be blocked.
+struct repair_t {
+    const CTP::graph_t &graph_;
+    const distances_t &parent_;
+    const std::vector<int> &removed_;
+    const state_info_t &info_;
+    bool optimistic_;
+    repair_t(const CTP::graph_t &graph, const distances_t &parent, const std::vector<int> &removed, const state_info_t &info, bool optimistic)
+      : graph_(graph), parent_(parent), removed_(removed), info_(info), optimistic_(optimistic) { }
+    void operator()(distances_t *distances) const {
+        memcpy(distances->values(), parent_.values(), graph_.num_nodes_ * sizeof(int));
+        graph_.repair(distances->values(), removed_, info_.known_.words_, info_.blocked_.words_, optimistic_);
     }
 };
 
+// Bounded cache of shortest-path distances keyed by (source, edge info).
+// Distance arrays live in a single slab of capacity slots that is split
+// into shards; each shard has its own lock, index and CLOCK hand, so
+// concurrent planners only contend when they hit the same shard. Slots
+// still referenced by states are pinned and skipped by the CLOCK hand.
+// When the CLOCK hand finds no victim within a bounded number of probes,
+// the distances are computed into a fresh array that is not cached.
+// On a miss the victim slot is pinned by the caller's reference and
+// filled outside the shard lock, so a Dijkstra does not stall the other
+// lookups into the shard. Hit rates are recorded over windows of lookups
+// so that drifting working sets show up in the statistics; only the last
+// history_size windows are kept.
 class shortest_path_cache_t {
+    struct slot_t {
+        shortest_path_key_t key_;
+        bool used_;
+        bool referenced_;
+        slot_t() : used_(false), referenced_(false) { }
+    };
+
+    struct shard_t {
+        std::mutex mutex_;
+        std::unordered_map<shortest_path_key_t, unsigned, cache_functions_t, cache_functions_t> index_;
+        unsigned begin_;
+        unsigned end_;
+        unsigned hand_;
+        shard_t() : begin_(0), end_(0), hand_(0) { }
+    };
+
     int num_nodes_;
-    int *distances_;
-    shortest_path_cache_item_t **items_;
+    size_t slot_size_;
     unsigned capacity_;
-    unsigned size_;
-    unsigned lookups_;
-    unsigned hits_;
+    unsigned num_shards_;
+    char *slab_;
+    std::vector<slot_t> slots_;
+    shard_t *shards_;
+
+    unsigned window_;
+    std::atomic<unsigned> lookups_;
+    std::atomic<unsigned> hits_;
+    std::atomic<unsigned> evictions_;
+    std::atomic<unsigned> uncached_;
+    std::mutex history_mutex_;
+    unsigned window_hits_;
+    static const size_t history_size = 64;
+    std::vector<float> history_; // ring of the last history_size windows
+    size_t windows_;
+
+    distances_t* slot_distances(unsigned slot) const {
+        return reinterpret_cast<distances_t*>(slab_ + slot * slot_size_);
+    }
+
+    // CLOCK: returns a free or evicted slot of the shard, or -1 if none
+    // is found within a bounded number of probes (slots are pinned)
+    int victim(shard_t &shard) {
+        unsigned size = shard.end_ - shard.begin_;
+        unsigned probes = 2 * size < 64 ? 2 * size : 64;
+        for( unsigned i = 0; i < probes; ++i ) {
+            unsigned slot = shard.hand_;
+            shard.hand_ = slot + 1 == shard.end_ ? shard.begin_ : slot + 1;
+            if( slot_distances(slot)->references() > 1 ) continue;
+            if( !slots_[slot].used_ ) return slot;
+            if( slots_[slot].referenced_ ) {
+                slots_[slot].referenced_ = false;
+            } else {
+                shard.index_.erase(slots_[slot].key_);
+                slots_[slot].used_ = false;
+                ++evictions_;
+                return slot;
+            }
+        }
+        return -1;
+    }
+
+    void record(bool hit) {
+        if( hit ) ++hits_;
+        unsigned lookups = ++lookups_;
+        if( lookups % window_ == 0 ) {
+            std::unique_lock<std::mutex> lock(history_mutex_);
+            unsigned hits = hits_;
+            float ratio = (float)(hits - window_hits_) / (float)window_;
+            if( history_.size() < history_size )
+                history_.push_back(ratio);
+            else
+                history_[windows_ % history_size] = ratio;
+            ++windows_;
+            window_hits_ = hits;
+        }
+    }
 
   public:
     shortest_path_cache_t()
-      : num_nodes_(0), items_(0),
-        capacity_(0), size_(0),
-        lookups_(0), hits_(0) { }
+      : num_nodes_(0), slot_size_(0), capacity_(0), num_shards_(0),
+        slab_(0), shards_(0), window_(10000),
+        lookups_(0), hits_(0), evictions_(0), uncached_(0), window_hits_(0), windows_(0) { }
     ~shortest_path_cache_t() {
-        for( int i = 0; i < num_nodes_; ++i )
-            delete items_[i];
-        delete[] items_;
+        delete[] shards_;
+        delete[] slab_;
     }
 
-    void initialize(int num_nodes, unsigned capacity) {
+    void initialize(int num_nodes, unsigned capacity, unsigned num_shards = 16) {
+        assert(slab_ == 0);
         num_nodes_ = num_nodes;
+        slot_size_ = distances_t::size(num_nodes);
         capacity_ = capacity;
-        distances_ = new int[num_nodes_];
-        items_ = new shortest_path_cache_item_t*[num_nodes_];
-        for( int i = 0; i < num_nodes_; ++i )
-            items_[i] = new shortest_path_cache_item_t;
+        if( capacity_ == 0 ) return;
+
+        num_shards_ = num_shards < capacity_ ? num_shards : capacity_;
+        slab_ = new char[capacity_ * slot_size_];
+        slots_ = std::vector<slot_t>(capacity_);
+        for( unsigned slot = 0; slot < capacity_; ++slot )
+            new(slot_distances(slot)) distances_t;
+        shards_ = new shard_t[num_shards_];
+        for( unsigned i = 0; i < num_shards_; ++i ) {
+            shards_[i].begin_ = (unsigned)(((size_t)i * capacity_) / num_shards_);
+            shards_[i].end_ = (unsigned)(((size_t)(i + 1) * capacity_) / num_shards_);
+            shards_[i].hand_ = shards_[i].begin_;
+        }
     }
 
     void clear() {
-        for( int i = 0; i < num_nodes_; ++i )
-            items_[i]->clear();
+        for( unsigned i = 0; i < num_shards_; ++i ) {
+            std::unique_lock<std::mutex> lock(shards_[i].mutex_);
+            shards_[i].index_.clear();
+            for( unsigned slot = shards_[i].begin_; slot < shards_[i].end_; ++slot )
+                slots_[slot].used_ = false;
+        }
     }
 
-    std::pair<bool, const int*> lookup(const CTP::graph_t &graph, int source, const state_info_t &info) {
-        ++lookups_;
-        shortest_path_cache_item_t *item = items_[source];
-        shortest_path_cache_item_t::const_iterator it = item->find(info);
-        if( it != item->end() ) {
-            ++hits_;
-            return std::make_pair(true, it->second);
-        } else {
-            if( size_ < capacity_ ) {
-                ++size_;
-                int *distances = new int[num_nodes_];
-                graph.dijkstra(source, distances, info.known_, info.blocked_, false);
-                distances[source] = graph.bfs(source, num_nodes_ - 1, info.known_, info.blocked_, true);
-                item->insert(std::make_pair(info, distances));
-                return std::make_pair(true, distances);
-            } else {
-                graph.dijkstra(source, distances_, info.known_, info.blocked_, false);
-                distances_[source] = graph.bfs(source, num_nodes_ - 1, info.known_, info.blocked_, true);
-                return std::make_pair(false, distances_);
+    // returns the distances for key with a reference for the caller;
+    // compute(distances) fills the values on a miss
+    template<typename F>
+    distances_t* lookup(const shortest_path_key_t &key, F &compute) {
+        if( capacity_ > 0 ) {
+            shard_t &shard = shards_[key.hash() % num_shards_];
+            std::unique_lock<std::mutex> lock(shard.mutex_);
+            std::unordered_map<shortest_path_key_t, unsigned, cache_functions_t, cache_functions_t>::const_iterator it = shard.index_.find(key);
+            if( it != shard.index_.end() ) {
+                slots_[it->second].referenced_ = true;
+                record(true);
+                return distances_t::acquire(slot_distances(it->second));
+            }
+
+            int slot = victim(shard);
+            if( slot != -1 ) {
+                // the caller's reference pins the slot while it is filled
+                distances_t *distances = distances_t::acquire(slot_distances(slot));
+                lock.unlock();
+                compute(distances);
+                lock.lock();
+                record(false);
+
+                // another planner may have inserted the key meanwhile;
+                // then its entry is used and the slot is left free
+                it = shard.index_.find(key);
+                if( it != shard.index_.end() ) {
+                    slots_[it->second].referenced_ = true;
+                    distances_t::release(distances);
+                    return distances_t::acquire(slot_distances(it->second));
+                }
+                slots_[slot].key_ = key;
+                slots_[slot].used_ = true;
+                slots_[slot].referenced_ = true;
+                shard.index_.insert(std::make_pair(key, (unsigned)slot));
+                return distances;
             }
         }
+
+        distances_t *distances = distances_t::allocate(num_nodes_);
+        compute(distances);
+        ++uncached_;
+        record(false);
+        return distances;
     }
 
+    unsigned size() const {
+        unsigned size = 0;
+        for( unsigned i = 0; i < num_shards_; ++i )
+            size += shards_[i].index_.size();
+        return size;
+    }
     unsigned lookups() const { return lookups_; }
-    float hit_ratio() const { return (float)hits_ / (float)lookups_; }
+    float hit_ratio() const { return lookups_ == 0 ? 0 : (float)hits_ / (float)lookups_; }
     void print_stats(std::ostream &os) {
         if( capacity_ > 0 ) {
-            os << "cache: #entries=" << size_
+            os << "cache: capacity=" << capacity_
+               << ", #shards=" << num_shards_
+               << ", #entries=" << size()
                << ", #lookups=" << lookups()
                << ", %hit=" << hit_ratio()
+               << ", #evictions=" << evictions_
+               << ", #uncached=" << uncached_
                << std::endl;
-            for( int i = 0; i < num_nodes_; ++i ) {
-                os << "  item[" << i << "]: ";
-                items_[i]->print_stats(os);
-                os << std::endl;
-            }
+            std::unique_lock<std::mutex> lock(history_mutex_);
+            std::streamsize precision = os.precision(2);
+            os << "cache: %hit-over-time(window=" << window_ << ",#windows=" << windows_ << "):";
+            size_t first = windows_ < history_size ? 0 : windows_ % history_size;
+            for( size_t i = 0; i < history_.size(); ++i )
+                os << " " << history_[(first + i) % history_.size()];
+            os << std::endl;
+            os.precision(precision);
         }
     }
 };
 
+// Memo of optimistic distances to the goal keyed by (node, blocked
+// edges), which is all they depend on since unknown edges count as
+// traversable. It saves the A* search of compute_heuristic() for states
+// that are rebuilt or reached again along other trials and decisions.
+// The memo is a direct-mapped table, as a transposition table: keys are
+// stored as 64-bit fingerprints and a new entry overwrites whatever is
+// in its slot. Slots are read and written without locks; each one keeps
+// the fingerprint XORed with the value, so a slot torn by a concurrent
+// write does not match any key and just counts as a miss.
+class heuristic_memo_t {
+    struct slot_t {
+        std::atomic<uint64_t> check_;
+        std::atomic<uint64_t> data_;
+        slot_t() : check_(0), data_(0) { }
+    };
+
+    unsigned capacity_;
+    slot_t *slots_;
+    std::atomic<unsigned> lookups_;
+    std::atomic<unsigned> hits_;
+
+    // fingerprint of (node, blocked); never 0, which marks empty slots
+    static uint64_t fingerprint(int node, const bitset_t<CTP_MAX_EDGES> &blocked) {
+        uint64_t x = 0x9e3779b97f4a7c15ULL;
+        for( int i = 0; i < bitset_t<CTP_MAX_EDGES>::num_words; ++i ) {
+            x = (x ^ blocked.words_[i]) * 0x9e3779b97f4a7c15ULL;
+            x ^= x >> 32;
+        }
+        x = (x ^ (uint64_t)node) * 0x9e3779b97f4a7c15ULL;
+        x ^= x >> 32;
+        return x == 0 ? 1 : x;
+    }
+    slot_t& slot(uint64_t key) const {
+        return slots_[(key >> 16) % capacity_];
+    }
+
+  public:
+    heuristic_memo_t()
+      : capacity_(0), slots_(0), lookups_(0), hits_(0) { }
+    ~heuristic_memo_t() {
+        delete[] slots_;
+    }
+
+    void initialize(unsigned capacity) {
+        assert(slots_ == 0);
+        capacity_ = capacity;
+        if( capacity_ > 0 ) slots_ = new slot_t[capacity_];
+    }
+
+    bool enabled() const { return capacity_ > 0; }
+
+    void clear() {
+        for( unsigned i = 0; i < capacity_; ++i ) {
+            slots_[i].check_.store(0, std::memory_order_relaxed);
+            slots_[i].data_.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // looks up (node, blocked); returns false on a miss
+    bool lookup(int node, const bitset_t<CTP_MAX_EDGES> &blocked, int &value) {
+        uint64_t key = fingerprint(node, blocked);
+        const slot_t &s = slot(key);
+        uint64_t data = s.data_.load(std::memory_order_relaxed);
+        uint64_t check = s.check_.load(std::memory_order_relaxed);
+        lookups_.fetch_add(1, std::memory_order_relaxed);
+        if( (check ^ data) != key ) return false;
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        value = (int)data;
+        return true;
+    }
+
+    void insert(int node, const bitset_t<CTP_MAX_EDGES> &blocked, int value) {
+        uint64_t key = fingerprint(node, blocked);
+        uint64_t data = (uint32_t)value;
+        slot_t &s = slot(key);
+        s.check_.store(key ^ data, std::memory_order_relaxed);
+        s.data_.store(data, std::memory_order_relaxed);
+    }
+
+    unsigned size() const {
+        unsigned size = 0;
+        for( unsigned i = 0; i < capacity_; ++i )
+            size += slots_[i].check_.load(std::memory_order_relaxed) != 0 ? 1 : 0;
+        return size;
+    }
+    void print_stats(std::ostream &os) const {
+        if( capacity_ > 0 ) {
+            os << "heuristic-memo: capacity=" << capacity_
+               << ", #entries=" << size()
+               << ", #lookups=" << lookups_
+               << ", %hit=" << (lookups_ == 0 ? 0 : (float)hits_ / (float)lookups_)
+               << std::endl;
+        }
+    }
+};
+
+// The instance that states belong to: the graph, the cache of
+// shortest-path distances computed for its states and the memo of their
+// heuristic values. States refer to their context, so several graphs can
+// be planned on in one process, possibly by concurrent threads (the
+// cache is sharded and locked, and the memo is lock-free).
+class context_t {
+  public:
+    const CTP::graph_t &graph_;
+    int num_nodes_;
+    int num_edges_;
+    bool use_cache_;
+    mutable shortest_path_cache_t cache_;
+    mutable heuristic_memo_t heuristic_memo_;
+
+    context_t(const CTP::graph_t &graph, bool use_cache, int cache_capacity, unsigned memo_capacity = 0)
+      : graph_(graph), num_nodes_(graph.num_nodes_), num_edges_(graph.num_edges_), use_cache_(use_cache) {
+        cache_.initialize(num_nodes_, use_cache ? cache_capacity : 0);
+        heuristic_memo_.initialize(memo_capacity);
+    }
+    ~context_t() { }
+
+    // checks that states have room for the graph
+    bool check(std::ostream &os) const {
+        if( num_nodes_ > CTP_MAX_NODES ) {
+            os << "error: number of nodes must be <= " << CTP_MAX_NODES
+               << " (rebuild with larger CTP_MAX_NODES)"
+               << std::endl;
+            return false;
+        }
+        if( num_edges_ > CTP_MAX_EDGES ) {
+            os << "error: number of edges must be <= " << CTP_MAX_EDGES
+               << " (rebuild with larger CTP_MAX_EDGES)"
+               << std::endl;
+            return false;
+        }
+        os << "init: #nodes=" << num_nodes_
+           << ", #edges=" << num_edges_
+           << ", #max-nodes=" << CTP_MAX_NODES
+           << ", #max-edges=" << CTP_MAX_EDGES
+           << std::endl;
+        return true;
+    }
+
+    void clear_cache() const {
+        cache_.clear();
+        heuristic_memo_.clear();
+    }
+    void print_stats(std::ostream &os) const {
+        cache_.print_stats(os);
+        heuristic_memo_.print_stats(os);
+    }
+};
+
 struct state_t {
     int current_;
     state_info_t info_;
-    unsigned visited_[WORDS_FOR_NODES];
-    mutable bool shared_;
-    mutable int *distances_;
+    bitset_t<CTP_MAX_NODES> visited_;
+    mutable distances_t *distances_;
+    mutable distances_t *goal_distances_;
+    mutable unsigned goal_pending_;
     mutable int heuristic_;
 
-    static const CTP::graph_t *graph_;
-    static int num_nodes_;
-    static int num_edges_;
-    static int words_for_nodes_;
-    static int words_for_edges_;
-    static shortest_path_cache_t cache_;
-    static bool use_cache_;
+    const context_t *context_;
 
   public:
-    state_t(int current = -1)
-      : current_(current), shared_(true), distances_(0), heuristic_(-1) {
-        memset(visited_, 0, WORDS_FOR_NODES * sizeof(unsigned));
+    state_t()
+      : current_(-1), distances_(0), goal_distances_(0), goal_pending_(0), heuristic_(-1), context_(0) {
+    }
+    state_t(const context_t &context, int current = -1)
+      : current_(current), distances_(0), goal_distances_(0), goal_pending_(0), heuristic_(-1), context_(&context) {
     }
     state_t(const state_t &s)
-      : shared_(true), distances_(0) {
+      : distances_(0), goal_distances_(0), goal_pending_(0) {
         *this = s;
     }
     ~state_t() {
-        if( !shared_ ) delete[] distances_;
+        distances_t::release(distances_);
+        distances_t::release(goal_distances_);
     }
 
-    static void initialize(const CTP::graph_t &graph, bool use_cache, int cache_capacity) {
-        graph_ = &graph;
-        num_nodes_ = graph.num_nodes_;
-        num_edges_ = graph.num_edges_;
+    size_t hash() const { return info_.hash(); }
 
-        if( num_nodes_ > (int)(WORDS_FOR_NODES * sizeof(unsigned) * 8) ) {
-            std::cout << "error: number of nodes must be <= "
-                      <<  WORDS_FOR_NODES * sizeof(unsigned) * 8
-                      << std::endl;
-            exit(1);
+    // Optimistic distances to the goal (unknown edges are traversable).
+    // They depend only on the blocked edges, so they are keyed by the
+    // goal and the blocked bits alone (complemented goal as source).
+    shortest_path_key_t goal_key() const {
+        state_info_t info;
+        info.assign_blocked(info_.blocked_);
+        return shortest_path_key_t(~(context_->num_nodes_ - 1), info);
+    }
+    template<typename F> distances_t* make_distances(const shortest_path_key_t &key, F &compute) const {
+        if( context_->use_cache_ ) return context_->cache_.lookup(key, compute);
+        distances_t *distances = distances_t::allocate(context_->num_nodes_);
+        compute(distances);
+        return distances;
+    }
+    // Goal distances are computed from scratch, or repaired from those
+    // of the parent for the edges at the current node that turned out
+    // blocked (bits of goal_pending_ index at_[current_]). Distances from
+    // the current node cannot be derived this way because the source
+    // moves, but the goal does not. If no removed edge is tight, the
+    // parent's vector is shared as is; otherwise it is repaired only if
+    // repair is true, since the heuristic alone is cheaper with A*.
+    void resolve_goal_distances(bool repair) const {
+        if( goal_pending_ != 0 ) {
+            const CTP::graph_t &graph = context_->graph_;
+            std::vector<int> removed;
+            for( int i = 0, isz = graph.at_[current_].size(); i < isz; ++i ) {
+                if( goal_pending_ & (1 << i) ) removed.push_back(graph.at_[current_][i]);
+            }
+            if( !graph.tight(goal_distances_->values(), removed) ) {
+                goal_pending_ = 0;
+            } else if( repair ) {
+                goal_pending_ = 0;
+                distances_t *parent = goal_distances_;
+                repair_t repair(graph, *parent, removed, info_, true);
+                goal_distances_ = make_distances(goal_key(), repair);
+                distances_t::release(parent);
+            }
         }
-
-        if( num_edges_ > (int)(WORDS_FOR_EDGES * sizeof(unsigned) * 8) ) {
-            std::cout << "error: number of nodes must be <= "
-                      <<  WORDS_FOR_EDGES * sizeof(unsigned) * 8
-                      << std::endl;
-            exit(1);
+    }
+    void compute_goal_distances() const {
+        resolve_goal_distances(true);
+        if( goal_distances_ == 0 ) {
+            dijkstra_t dijkstra(context_->graph_, context_->num_nodes_ - 1, info_, true);
+            goal_distances_ = make_distances(goal_key(), dijkstra);
         }
-
-        words_for_nodes_ = num_nodes_ >> 5;
-        if( (num_nodes_ & 0x1F) != 0 ) ++words_for_nodes_;
-        words_for_edges_ = num_edges_ >> 5;
-        if( (num_edges_ & 0x1F) != 0 ) ++words_for_edges_;
-        std::cout << "init: #nodes=" << num_nodes_
-                  << ", #edges=" << num_edges_
-                  << ", #words-for-nodes=" << words_for_nodes_
-                  << ", #words-for-edges=" << words_for_edges_
-                  << std::endl;
-        state_info_t::initialize(words_for_edges_);
-        use_cache_ = use_cache;
-        cache_.initialize(num_nodes_, cache_capacity);
     }
-
-    static void clear_cache() {
-        cache_.clear();
+    int goal_distance(int node) const {
+        resolve_goal_distances(false);
+        if( (goal_distances_ == 0) || (goal_pending_ != 0) ) {
+            int distance = prior_goal_distance(node);
+            if( distance != -1 ) return distance;
+        }
+        compute_goal_distances();
+        return (*goal_distances_)[node];
+    }
+
+    // Optimistic distance from node to the goal read from the all-pairs
+    // matrices of the graph, valid when the blocked edges do not matter:
+    // either the pessimistic distance equals the optimistic one, or no
+    // blocked edge lies on a shortest path of the full graph. Returns -1
+    // otherwise, or if the graph is too large to have the matrices.
+    int prior_goal_distance(int node) const {
+        const CTP::graph_t &graph = context_->graph_;
+        int goal = context_->num_nodes_ - 1;
+        int distance = graph.heuristic(node);
+        if( distance == INT_MAX ) return distance;
+        if( !graph.has_all_pairs() ) return -1;
+        if( graph.pessimistic_distance(node, goal) == distance )
+            return distance;
+        for( int i = 0; i < bitset_t<CTP_MAX_EDGES>::num_words; ++i ) {
+            for( CTP::word_t bits = info_.blocked_.words_[i]; bits != 0; bits &= bits - 1 ) {
+                int e = (i << 6) + __builtin_ctzll(bits);
+                int n1 = graph.from(e), n2 = graph.to(e), cost = graph.cost(e);
+                int d1 = graph.optimistic_distance(node, n1), d2 = graph.optimistic_distance(node, n2);
+                if( (d1 != INT_MAX) && (d1 + cost + graph.heuristic(n2) == distance) ) return -1;
+                if( (d2 != INT_MAX) && (d2 + cost + graph.heuristic(n1) == distance) ) return -1;
+            }
+        }
+        return distance;
+    }
+
+    // Makes this state, a successor of parent after moving to a node and
+    // revealing its edges, take the goal distances of parent and repair
+    // them on demand. If parent has no (resolved) goal distances, or the
+    // node has more than 32 edges, they are computed from scratch when
+    // needed.
+    void derive_goal_distances(const state_t &parent) {
+        distances_t::release(goal_distances_);
+        goal_distances_ = 0;
+        goal_pending_ = 0;
+        const std::vector<int> &edges = context_->graph_.at_[current_];
+        if( (parent.goal_distances_ == 0) || (edges.size() > 32) ) return;
+        parent.resolve_goal_distances(false);
+        if( parent.goal_pending_ != 0 ) return;
+        goal_distances_ = distances_t::acquire(parent.goal_distances_);
+        for( int i = 0, isz = edges.size(); i < isz; ++i ) {
+            int e = edges[i];
+            if( !parent.known(e) && !traversable(e) ) goal_pending_ |= 1 << i;
+        }
     }
 
-    static void print_stats(std::ostream &os) {
-        cache_.print_stats(os);
+    int optimistic_bfs(int node) const {
+        return context_->graph_.bfs(node, context_->num_nodes_ - 1, info_.known_.words_, info_.blocked_.words_, true);
     }
 
-    size_t hash() const { return info_.hash(); }
-
+    // optimistic distance to goal; read from the goal distances, the
+    // all-pairs matrices or the memo of the context when possible and
+    // computed with A* otherwise
     void compute_heuristic() const {
         if( heuristic_ == -1 ) {
-            heuristic_ = graph_->bfs(current_ == -1 ? 0 : current_, num_nodes_ - 1,
-                                     info_.known_, info_.blocked_, true);
+            int node = current_ == -1 ? 0 : current_;
+            resolve_goal_distances(false);
+            if( (goal_distances_ != 0) && (goal_pending_ == 0) ) {
+                heuristic_ = (*goal_distances_)[node];
+            } else if( (heuristic_ = prior_goal_distance(node)) == -1 ) {
+                heuristic_memo_t &memo = context_->heuristic_memo_;
+                if( !memo.enabled() ) {
+                    heuristic_ = optimistic_bfs(node);
+                } else if( !memo.lookup(node, info_.blocked_, heuristic_) ) {
+                    heuristic_ = optimistic_bfs(node);
+                    memo.insert(node, info_.blocked_, heuristic_);
+                }
+            }
         }
     }
 
     bool known(int edge) const { return info_.known(edge); }
     bool traversable(int edge) const { return info_.traversable(edge); }
     bool visited(int node) const {
-        int n = node >> 5, offset = node & 0x1F;
-        int mask = 1 << offset;
-        return visited_[n] & mask;
+        return visited_.test(node);
     }
     bool reachable(int node) const {
         preprocess();
-        return distances_[node] < INT_MAX;
+        return (*distances_)[node] < INT_MAX;
     }
     int distance_to(int node) const {
         preprocess();
-        return distances_[node];
+        return (*distances_)[node];
     }
     bool perimeter(int node) const {
         return !visited(node) && reachable(node);
@@ -345,71 +792,55 @@ struct state_t {
         info_.set_edge_status(edge, blocked);
     }
     void move_to(int node) {
-        int n = node >> 5, offset = node & 0x1F;
-        int mask = 1 << offset;
         current_ = node;
-        visited_[n] |= mask;
+        visited_.set(node);
     }
 
     void preprocess() const {
         if( distances_ == 0 ) {
-            assert(shared_);
-            std::pair<bool, const int*> p(false, 0);
-            if( use_cache_ ) p = cache_.lookup(*graph_, current_, info_);
-            if( p.first ) {
-                if( !shared_ ) delete[] distances_;
-                distances_ = const_cast<int*>(p.second);
-                shared_ = true;
-            } else {
-                if( shared_ ) distances_ = new int[num_nodes_];
-                assert(distances_ != 0);
-                shared_ = false;
-                if( p.second ) {
-                    memcpy(const_cast<int*>(distances_), p.second, num_nodes_ * sizeof(int));
-                } else {
-                    graph_->dijkstra(current_, distances_, info_.known_, info_.blocked_, false);
-                    //distances_[current_] = graph_->bfs(current_, num_nodes_ - 1, info_.known_, info_.blocked_, true);
-                }
-            }
-            //heuristic_ = distances_[current_];
+            dijkstra_t dijkstra(context_->graph_, current_, info_, false);
+            distances_ = make_distances(shortest_path_key_t(current_, info_), dijkstra);
         }
     }
 
+    // drop distances and heuristic after changing current node or edges
+    void invalidate() const {
+        distances_t::release(distances_);
+        distances_t::release(goal_distances_);
+        distances_ = 0;
+        goal_distances_ = 0;
+        goal_pending_ = 0;
+        heuristic_ = -1;
+    }
+
     void clear() {
         current_ = 0;
         info_.clear();
-        memset(visited_, 0, words_for_nodes_ * sizeof(unsigned));
-        if( !shared_ ) {
-            delete[] distances_;
-            shared_ = true;
-        }
-        distances_ = 0;
-        heuristic_ = -1;
+        visited_.clear();
+        invalidate();
     }
 
     const state_t& operator=(const state_t &s) {
         current_ = s.current_;
         info_ = s.info_;
-        memcpy(visited_, s.visited_, words_for_nodes_ * sizeof(unsigned));
-        if( s.shared_ ) {
-            if( !shared_ ) delete[] distances_;
-            distances_ = s.distances_;
-            shared_ = true;
-        } else {
-            if( shared_ ) {
-                distances_ = new int[num_nodes_];
-                shared_ = false;
-            }
-            assert(distances_ != 0);
-            memcpy(const_cast<int*>(distances_), s.distances_, num_nodes_ * sizeof(int));
+        context_ = s.context_;
+        visited_ = s.visited_;
+        if( distances_ != s.distances_ ) {
+            distances_t::release(distances_);
+            distances_ = distances_t::acquire(s.distances_);
+        }
+        if( goal_distances_ != s.goal_distances_ ) {
+            distances_t::release(goal_distances_);
+            goal_distances_ = distances_t::acquire(s.goal_distances_);
         }
+        goal_pending_ = s.goal_pending_;
         heuristic_ = s.heuristic_;
         return *this;
     }
     bool operator==(const state_t &s) const {
         return (current_ == s.current_) &&
                (info_ == s.info_) &&
-               (memcmp(visited_, s.visited_, words_for_nodes_ * sizeof(unsigned)) == 0);
+               (visited_ == s.visited_);
     }
     bool operator!=(const state_t &s) const {
         return *this == s ? false : true;
@@ -418,31 +849,63 @@ struct state_t {
         return (current_ < s.current_) ||
                ((current_ == s.current_) && (info_ < s.info_)) ||
                ((current_ == s.current_) && (info_ == s.info_) &&
-                (memcmp(visited_, s.visited_, words_for_nodes_ * sizeof(unsigned)) < 0));
+                (visited_.compare(s.visited_) < 0));
     }
     void print(std::ostream &os) const {
         os << "(" << current_ << "," << info_ << ",V={";
-        for( int i = 0; i < words_for_nodes_; ++i )
-            os << print_bits_t<unsigned>(visited_[i], i << 5);
+        visited_.print(os);
         os << "}";
         if( is_dead_end() ) os << ",DEAD";
         os << ")";
     }
 };
 
-const CTP::graph_t *state_t::graph_ = 0;
-int state_t::num_nodes_ = 0;
-int state_t::num_edges_ = 0;
-int state_t::words_for_nodes_ = 0;
-int state_t::words_for_edges_ = 0;
-shortest_path_cache_t state_t::cache_;
-bool state_t::use_cache_ = false;
-
 inline std::ostream& operator<<(std::ostream &os, const state_t &s) {
     s.print(os);
     return os;
 }
 
+// The plain-data part of a state: what identifies it, without the
+// distances and context that only mean something in this process. Tables
+// store it in place of states (see Table::key_t).
+struct state_key_t {
+    int current_;
+    state_info_t info_;
+    bitset_t<CTP_MAX_NODES> visited_;
+
+    size_t hash() const { return info_.hash(); }
+    bool operator==(const state_key_t &key) const {
+        return (current_ == key.current_) &&
+               (info_ == key.info_) &&
+               (visited_ == key.visited_);
+    }
+    void print(std::ostream &os) const {
+        os << "(" << current_ << "," << info_ << ",V={";
+        visited_.print(os);
+        os << "})";
+    }
+};
+
+inline std::ostream& operator<<(std::ostream &os, const state_key_t &key) {
+    key.print(os);
+    return os;
+}
+
+namespace Table {
+
+template<> struct key_t<state_t> {
+    typedef state_key_t type;
+    static state_key_t make(const state_t &s) {
+        state_key_t key;
+        key.current_ = s.current_;
+        key.info_ = s.info_;
+        key.visited_ = s.visited_;
+        return key;
+    }
+};
+
+};
+
 
 struct next_cache_functions_t {
     bool operator()(const state_t &s1, const state_t &s2) const {
@@ -453,12 +916,32 @@ struct next_cache_functions_t {
     }
 };
 
+// Outcomes of an action stored as a delta over the parent state: all
+// outcomes differ only in the status of the edges at the destination that
+// are unknown in the parent, so each one is a bitmask over those edges
+// (bit i set if unknown_edges_[i] is blocked) and its probability. States
+// are rebuilt from the parent on lookup.
+struct next_cache_entry_t {
+    std::vector<int> unknown_edges_;
+    std::vector<std::pair<unsigned, float> > outcomes_;
+
+    size_t bytes() const {
+        return sizeof(next_cache_entry_t) +
+               unknown_edges_.capacity() * sizeof(int) +
+               outcomes_.capacity() * sizeof(std::pair<unsigned, float>);
+    }
+};
+
 class next_cache_item_t
   : public std::unordered_map<state_t,
-                              std::vector<std::pair<state_t, float> >*,
+                              next_cache_entry_t*,
                               next_cache_functions_t,
                               next_cache_functions_t> {
   public:
+    ~next_cache_item_t() {
+        for( const_iterator it = begin(); it != end(); ++it )
+            delete it->second;
+    }
     void print_stats(std::ostream &os) const {
         int maxsz = 0;
         for( int i = 0; i < (int)bucket_count(); ++i ) {
@@ -476,13 +959,14 @@ class next_cache_t {
     next_cache_item_t **items_;
     unsigned capacity_;
     unsigned size_;
+    size_t bytes_;
     mutable unsigned lookups_;
     mutable unsigned hits_;
 
   public:
     next_cache_t()
       : num_actions_(0), items_(0),
-        capacity_(0), size_(0),
+        capacity_(0), size_(0), bytes_(0),
         lookups_(0), hits_(0) { }
     ~next_cache_t() {
         for( int i = 0; i < num_actions_; ++i )
@@ -498,8 +982,7 @@ class next_cache_t {
             items_[i] = new next_cache_item_t;
     }
 
-    const std::vector<std::pair<state_t, float> >* lookup(const state_t &state,
-                                                          Problem::action_t a) const {
+    const next_cache_entry_t* lookup(const state_t &state, Problem::action_t a) const {
         ++lookups_;
         next_cache_item_t *item = items_[a];
         next_cache_item_t::const_iterator it = item->find(state);
@@ -510,15 +993,28 @@ class next_cache_t {
             return 0;
     }
 
+    // encodes outcomes of a in state (as generated for the unknown edges
+    // given) relative to state; the key keeps no distances
     void insert(const state_t &state,
                 Problem::action_t a,
-                std::vector<std::pair<state_t, float> > &next) {
+                const std::vector<int> &unknown_edges,
+                const std::vector<std::pair<state_t, float> > &next) {
         if( size_ < capacity_ ) {
             ++size_;
-            next_cache_item_t *item = items_[a];
-            std::vector<std::pair<state_t, float> > *ptr
-              = new std::vector<std::pair<state_t, float> >(next);
-            item->insert(std::make_pair(state, ptr));
+            next_cache_entry_t *entry = new next_cache_entry_t;
+            entry->unknown_edges_ = unknown_edges;
+            entry->outcomes_.reserve(next.size());
+            for( int i = 0, isz = next.size(); i < isz; ++i ) {
+                unsigned mask = 0;
+                for( int j = 0, jsz = unknown_edges.size(); j < jsz; ++j ) {
+                    if( !next[i].first.traversable(unknown_edges[j]) ) mask |= 1 << j;
+                }
+                entry->outcomes_.push_back(std::make_pair(mask, next[i].second));
+            }
+            state_t key(state);
+            key.invalidate();
+            bytes_ += sizeof(state_t) + entry->bytes();
+            items_[a]->insert(std::make_pair(key, entry));
         }
     }
 
@@ -527,6 +1023,7 @@ class next_cache_t {
     void print_stats(std::ostream &os) {
         if( capacity_ > 0 ) {
             os << "next_cache: #entries=" << size_
+               << ", #bytes=" << bytes_
                << ", #lookups=" << lookups()
                << ", %hit=" << hit_ratio()
                << std::endl;
@@ -542,20 +1039,22 @@ class next_cache_t {
 
 class problem_t : public Problem::problem_t<state_t> {
   public:
+    const context_t &context_;
     const CTP::graph_t &graph_;
     const state_t init_;
     int start_, goal_;
     mutable int max_branching_;
     mutable float avg_branching_;
+    mutable unsigned branchings_;
     bool use_cache_;
     mutable next_cache_t next_cache_;
 
   public:
-    problem_t(CTP::graph_t &graph, float dead_end_value = 1e3, bool use_cache = false, unsigned cache_size = (int)1e4)
+    problem_t(const context_t &context, float dead_end_value = 1e3, bool use_cache = false, unsigned cache_size = (int)1e4)
       : Problem::problem_t<state_t>(DISCOUNT, dead_end_value),
-        graph_(graph), init_(-1), start_(0), goal_(graph_.num_nodes_ - 1),
-        max_branching_(0), avg_branching_(0), use_cache_(use_cache) {
-        next_cache_.initialize(graph.num_nodes_, cache_size);
+        context_(context), graph_(context.graph_), init_(context, -1), start_(0), goal_(graph_.num_nodes_ - 1),
+        max_branching_(0), avg_branching_(0), branchings_(0), use_cache_(use_cache) {
+        next_cache_.initialize(graph_.num_nodes_, cache_size);
     }
     virtual ~problem_t() { }
 
@@ -576,77 +1075,156 @@ class problem_t : public Problem::problem_t<state_t> {
     virtual float cost(const state_t &s, Problem::action_t a) const {
         return s.current_ == -1 ? 0 : s.distance_to(a);
     }
+
+    // node reached by a in s: the start node for the initial action
+    int destination(const state_t &s, Problem::action_t a) const {
+        if( s.current_ == -1 ) return start_;
+        assert(a != s.current_);
+        return a;
+    }
+
+    // branching statistics for a transition with k unknown edges
+    void update_branching(int k) const {
+        ++branchings_;
+        max_branching_ = (1<<k) > max_branching_ ? (1<<k) : max_branching_;
+        avg_branching_ = (branchings_ - 1) * avg_branching_ + (float)(1<<k);
+        avg_branching_ /= (float)branchings_;
+    }
+
+    // Calls f(next, p) for each outcome of a in s with positive
+    // probability. Subsets of unknown edges at the destination are walked
+    // in Gray-code order so that consecutive outcomes differ in a single
+    // edge. The probability is updated incrementally from the product of
+    // the nonzero factors and the number of zero factors. The state passed
+    // to f is reused across calls; f must copy it to keep it.
+    template<typename F>
+    void for_each_outcome(const state_t &s, Problem::action_t a, F &f) const {
+        int to_node = destination(s, a);
+
+        // collect edges adjacent at to_node of unknown status; start
+        // with all of them traversable
+        int k = 0;
+        state_t next(s);
+        double product = 1;
+        int zeros = 0;
+        std::vector<int> unknown_edges;
+        unknown_edges.reserve(graph_.at_[to_node].size());
+        for( int i = 0, isz = graph_.at_[to_node].size(); i < isz; ++i ) {
+            int e = graph_.at_[to_node][i];
+            if( !s.known(e) ) {
+                unknown_edges.push_back(e);
+                next.info_.set_edge_status(e, false);
+                if( graph_.prob(e) == 0 )
+                    ++zeros;
+                else
+                    product *= graph_.prob(e);
+                ++k;
+            }
+        }
+        update_branching(k);
+
+        next.move_to(to_node);
+        for( unsigned i = 0, isz = 1 << k; i < isz; ++i ) {
+            if( i > 0 ) {
+                // flip the edge given by the lowest set bit of i
+                int j = __builtin_ctz(i);
+                int e = unknown_edges[j];
+                bool blocked = (((i ^ (i >> 1)) >> j) & 1) != 0;
+                float old_factor = blocked ? graph_.prob(e) : 1 - graph_.prob(e);
+                float new_factor = blocked ? 1 - graph_.prob(e) : graph_.prob(e);
+                if( old_factor == 0 ) --zeros; else product /= old_factor;
+                if( new_factor == 0 ) ++zeros; else product *= new_factor;
+                next.info_.set_edge_status(e, blocked);
+            }
+
+            // distances and heuristic may have been computed by f
+            next.invalidate();
+            if( zeros == 0 ) {
+                next.derive_goal_distances(s);
+                f(next, (float)product);
+            }
+        }
+    }
+
+    // consumer for for_each_outcome() that fills a vector of outcomes
+    struct outcome_collector_t {
+        std::vector<std::pair<state_t, float> > &outcomes_;
+        outcome_collector_t(std::vector<std::pair<state_t, float> > &outcomes)
+          : outcomes_(outcomes) { }
+        void operator()(const state_t &s, float p) {
+            outcomes_.push_back(std::make_pair(s, p));
+        }
+    };
+
     virtual void next(const state_t &s,
                       Problem::action_t a,
                       std::vector<std::pair<state_t, float> > &outcomes) const {
 
         if( use_cache_ ) {
-            const std::vector<std::pair<state_t, float> > *ptr = next_cache_.lookup(s, a);
-            if( ptr != 0 ) {
-                outcomes = *ptr;
+            const next_cache_entry_t *entry = next_cache_.lookup(s, a);
+            if( entry != 0 ) {
+                decode_outcomes(s, a, *entry, outcomes);
                 return;
             }
         }
 
-        //std::cout << "next" << s << " w/ a=" << a << " is:" << std::endl;
+        inc_expansions();
+        outcomes.clear();
+        outcome_collector_t collector(outcomes);
+        for_each_outcome(s, a, collector);
 
-        ++expansions_;
+        if( use_cache_ ) {
+            int to_node = destination(s, a);
+            std::vector<int> unknown_edges;
+            for( int i = 0, isz = graph_.at_[to_node].size(); i < isz; ++i ) {
+                int e = graph_.at_[to_node][i];
+                if( !s.known(e) ) unknown_edges.push_back(e);
+            }
+            next_cache_.insert(s, a, unknown_edges, outcomes);
+        }
+    }
 
-        int to_node = -1;
-        if( s.current_ == -1 ) {
-            to_node = start_;
-        } else {
-            to_node = a;
-            assert(to_node != s.current_);
+    // rebuilds the outcomes of a in s from a cache entry, in the order
+    // in which for_each_outcome() generated them
+    void decode_outcomes(const state_t &s,
+                         Problem::action_t a,
+                         const next_cache_entry_t &entry,
+                         std::vector<std::pair<state_t, float> > &outcomes) const {
+        outcomes.clear();
+        outcomes.reserve(entry.outcomes_.size());
+        state_t next(s);
+        next.move_to(destination(s, a));
+        for( int i = 0, isz = entry.outcomes_.size(); i < isz; ++i ) {
+            unsigned mask = entry.outcomes_[i].first;
+            for( int j = 0, jsz = entry.unknown_edges_.size(); j < jsz; ++j )
+                next.info_.set_edge_status(entry.unknown_edges_[j], ((mask >> j) & 1) != 0);
+            next.invalidate();
+            next.derive_goal_distances(s);
+            outcomes.push_back(std::make_pair(next, entry.outcomes_[i].second));
         }
+    }
+
+    // sample by flipping a biased coin for each unknown edge at the
+    // destination node instead of enumerating the 2^k outcomes
+    virtual std::pair<state_t, bool> sample(const state_t &s, Problem::action_t a) const {
+        if( sample_cache_ != 0 ) return Problem::problem_t<state_t>::sample(s, a);
+
+        int to_node = destination(s, a);
 
-        // collect edges adjacent at to_node of unknown status
         int k = 0;
-        std::vector<int> unknown_edges;
-        unknown_edges.reserve(graph_.num_edges_);
+        state_t next(s);
         for( int i = 0, isz = graph_.at_[to_node].size(); i < isz; ++i ) {
             int e = graph_.at_[to_node][i];
             if( !s.known(e) ) {
-                unknown_edges.push_back(e);
+                next.info_.set_edge_status(e, Random::real() < graph_.prob(e) ? false : true);
                 ++k;
             }
         }
-        max_branching_ = (1<<k) > max_branching_ ? (1<<k) : max_branching_;
-        avg_branching_ = (expansions_ - 1) * avg_branching_ + (float)(1<<k);
-        avg_branching_ /= (float)expansions_;
-
-        // generate subsets of unknowns edges and update weathers
-        outcomes.clear();
-        outcomes.reserve(1 << k);
-        for( int i = 0, isz = 1 << k; i < isz; ++i ) {
-            state_t next(s);
-            float p = 1;
-            int subset = i;
-            for( int j = 0; j < k; ++j ) {
-                int e = unknown_edges[j];
-                p *= (subset & 1) ? 1 - graph_.prob(e) : graph_.prob(e);
-                next.info_.set_edge_status(e, subset & 1);
-                subset = subset >> 1;
-            }
-            next.move_to(to_node);
-            next.heuristic_ = -1;
-            if( next.shared_ ) {
-                next.distances_ = 0;
-            } else {
-                assert(next.distances_ != 0);
-                delete[] next.distances_;
-                next.distances_ = 0;
-                next.shared_ = true;
-            }
-            assert(next.distances_ == 0);
-            if( p > 0 ) {
-                //next.preprocess();
-                outcomes.push_back(std::make_pair(next, p));
-                //std::cout << "    " << next << " w.p. " << p << std::endl;
-            }
-        }
-
-        if( use_cache_ ) next_cache_.insert(s, a, outcomes);
+        update_branching(k);
+        next.move_to(to_node);
+        next.invalidate();
+        next.derive_goal_distances(s);
+        return std::make_pair(next, true);
     }
     virtual void print(std::ostream &os) const { }
 
@@ -665,8 +1243,8 @@ class problem_with_hidden_state_t : public problem_t {
     mutable state_t hidden_;
 
   public:
-    problem_with_hidden_state_t(CTP::graph_t &graph, float dead_end_value)
-      : problem_t(graph, dead_end_value) { }
+    problem_with_hidden_state_t(const context_t &context, float dead_end_value)
+      : problem_t(context, dead_end_value) { }
     virtual ~problem_with_hidden_state_t() { }
 
     void set_hidden(state_t &hidden) const {
@@ -676,17 +1254,11 @@ class problem_with_hidden_state_t : public problem_t {
     virtual void next(const state_t &s,
                       Problem::action_t a,
                       std::vector<std::pair<state_t, float> > &outcomes) const {
-        ++expansions_;
+        inc_expansions();
         outcomes.clear();
         outcomes.reserve(1);
 
-        int to_node = -1;
-        if( s.current_ == -1 ) {
-            to_node = start_;
-        } else {
-            to_node = a;
-            assert(to_node != s.current_);
-        }
+        int to_node = destination(s, a);
 
         // set unique outcome using hidden state
         state_t next(s);
@@ -695,19 +1267,19 @@ class problem_with_hidden_state_t : public problem_t {
             next.info_.set_edge_status(e, hidden_.traversable(e) ? false : true);
         }
         next.move_to(to_node);
-        next.heuristic_ = -1;
-        if( next.shared_ ) {
-            next.distances_ = 0;
-        } else {
-            assert(next.distances_ != 0);
-            delete[] next.distances_;
-            next.distances_ = 0;
-            next.shared_ = true;
-        }
+        next.invalidate();
+        next.derive_goal_distances(s);
         assert(next.distances_ == 0);
         //next.preprocess();
         outcomes.push_back(std::make_pair(next, 1));
     }
+
+    // transitions are deterministic given the hidden weather
+    virtual std::pair<state_t, bool> sample(const state_t &s, Problem::action_t a) const {
+        std::vector<std::pair<state_t, float> > outcomes;
+        next(s, a, outcomes);
+        return std::make_pair(outcomes[0].first, true);
+    }
 };
 
 
@@ -753,7 +1325,7 @@ class optimistic_policy_t : public Online::Policy::policy_t<state_t> {
         for( Problem::action_t a = 0; a < problem().number_actions(s); ++a ) {
             if( problem().applicable(s, a) ) {
                 float cost = problem().cost(s, a);
-                cost += graph_.bfs(a, graph_.num_nodes_ - 1, s.info_.known_, s.info_.blocked_, true) * multiplier_;
+                cost += s.goal_distance(a) * multiplier_;
                 if( cost < best_cost ) {
                     best_cost = cost;
                     best_action = a;
@@ -785,13 +1357,13 @@ void sample_weather(const CTP::graph_t &graph, state_t &state) {
 }
 
 inline
-float probability_bad_weather(const CTP::graph_t &graph, unsigned nsamples) {
+float probability_bad_weather(const context_t &context, unsigned nsamples) {
     float prob = 0;
-    state_t weather(0);
+    state_t weather(context, 0);
     for( unsigned i = 0; i < nsamples; ++i ) {
-        sample_weather(graph, weather);
+        sample_weather(context.graph_, weather);
         //weather.preprocess();
-        prob += weather.reachable(graph.num_nodes_ - 1) ? 0 : 1;
+        prob += weather.reachable(context.num_nodes_ - 1) ? 0 : 1;
     }
     return prob / nsamples;
 }
@@ -0,0 +1,261 @@
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <vector>
+
+#include "graph.h"
+#include <random.h>
+
+using namespace std;
+
+// Random CTP instances on planar graphs: the Delaunay triangulation of
+// nodes placed uniformly at random in a square, as in the instances of
+// Eyerich et al. The start (node 1) and goal (node n) are the nodes
+// closest to opposite corners. Edge costs are Euclidean distances; the
+// square has side 10 sqrt(n), so costs stay around 10 for any n.
+
+struct point_t {
+    double x_, y_;
+    point_t(double x = 0, double y = 0) : x_(x), y_(y) { }
+};
+
+struct triangle_t {
+    int v_[3];
+    double cx_, cy_, r2_; // circumcircle
+};
+
+triangle_t make_triangle(const vector<point_t> &points, int a, int b, int c) {
+    const point_t &pa = points[a], &pb = points[b], &pc = points[c];
+    double d = 2 * (pa.x_ * (pb.y_ - pc.y_) + pb.x_ * (pc.y_ - pa.y_) + pc.x_ * (pa.y_ - pb.y_));
+    double a2 = pa.x_ * pa.x_ + pa.y_ * pa.y_;
+    double b2 = pb.x_ * pb.x_ + pb.y_ * pb.y_;
+    double c2 = pc.x_ * pc.x_ + pc.y_ * pc.y_;
+    triangle_t t;
+    t.v_[0] = a;
+    t.v_[1] = b;
+    t.v_[2] = c;
+    t.cx_ = (a2 * (pb.y_ - pc.y_) + b2 * (pc.y_ - pa.y_) + c2 * (pa.y_ - pb.y_)) / d;
+    t.cy_ = (a2 * (pc.x_ - pb.x_) + b2 * (pa.x_ - pc.x_) + c2 * (pb.x_ - pa.x_)) / d;
+    t.r2_ = (pa.x_ - t.cx_) * (pa.x_ - t.cx_) + (pa.y_ - t.cy_) * (pa.y_ - t.cy_);
+    return t;
+}
+
+// Bowyer-Watson: points are inserted one at a time; the triangles whose
+// circumcircle contains the point are removed and the hole is filled
+// with triangles to the point. The last three points are the corners of
+// a triangle that contains all others; triangles incident to them are
+// dropped at the end. Edges are returned as (min,max) node pairs.
+void delaunay(vector<point_t> &points, vector<pair<int, int> > &edges) {
+    int n = points.size();
+    double side = 0;
+    for( int i = 0; i < n; ++i )
+        side = max(side, max(points[i].x_, points[i].y_));
+    double m = 20 * side + 1;
+    points.push_back(point_t(side / 2 - m, side / 2 - m));
+    points.push_back(point_t(side / 2 + m, side / 2 - m));
+    points.push_back(point_t(side / 2, side / 2 + m));
+
+    vector<triangle_t> triangles;
+    triangles.push_back(make_triangle(points, n, n + 1, n + 2));
+    vector<pair<int, int> > boundary;
+    for( int p = 0; p < n; ++p ) {
+        const point_t &pt = points[p];
+        boundary.clear();
+        for( size_t i = 0; i < triangles.size(); ) {
+            const triangle_t &t = triangles[i];
+            double dx = pt.x_ - t.cx_, dy = pt.y_ - t.cy_;
+            if( dx * dx + dy * dy < t.r2_ ) {
+                // edges shared by two removed triangles are interior
+                for( int j = 0; j < 3; ++j ) {
+                    pair<int, int> edge(min(t.v_[j], t.v_[(j + 1) % 3]), max(t.v_[j], t.v_[(j + 1) % 3]));
+                    vector<pair<int, int> >::iterator it = find(boundary.begin(), boundary.end(), edge);
+                    if( it != boundary.end() ) {
+                        *it = boundary.back();
+                        boundary.pop_back();
+                    } else {
+                        boundary.push_back(edge);
+                    }
+                }
+                triangles[i] = triangles.back();
+                triangles.pop_back();
+            } else {
+                ++i;
+            }
+        }
+        for( size_t i = 0; i < boundary.size(); ++i )
+            triangles.push_back(make_triangle(points, boundary[i].first, boundary[i].second, p));
+    }
+    points.resize(n);
+
+    edges.clear();
+    for( size_t i = 0; i < triangles.size(); ++i ) {
+        const triangle_t &t = triangles[i];
+        for( int j = 0; j < 3; ++j ) {
+            int a = t.v_[j], b = t.v_[(j + 1) % 3];
+            if( (a < n) && (b < n) ) edges.push_back(make_pair(min(a, b), max(a, b)));
+        }
+    }
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+}
+
+// number of nodes reachable from node 0
+int reachable(int n, const vector<pair<int, int> > &edges) {
+    vector<vector<int> > adj(n);
+    for( size_t i = 0; i < edges.size(); ++i ) {
+        adj[edges[i].first].push_back(edges[i].second);
+        adj[edges[i].second].push_back(edges[i].first);
+    }
+    vector<bool> seen(n, false);
+    vector<int> stack(1, 0);
+    seen[0] = true;
+    int count = 1;
+    while( !stack.empty() ) {
+        int node = stack.back();
+        stack.pop_back();
+        for( size_t i = 0; i < adj[node].size(); ++i ) {
+            if( !seen[adj[node][i]] ) {
+                seen[adj[node][i]] = true;
+                stack.push_back(adj[node][i]);
+                ++count;
+            }
+        }
+    }
+    return count;
+}
+
+void usage(ostream &os) {
+    os << "usage: generate [-b] [-c <f>] [-l <f>] [-s <n>] [-u <f>] <n> <file>"
+       << endl << endl
+       << "  -b        Write binary format. Default: text."
+       << endl
+       << "  -c <f>    Fraction of edges that cannot be blocked. Default: 0."
+       << endl
+       << "  -l <f>    Lower bound on probability that an edge is traversable. Default: 0."
+       << endl
+       << "  -s <n>    Random seed. Default: 0."
+       << endl
+       << "  -u <f>    Upper bound on probability that an edge is traversable. Default: 1."
+       << endl
+       << "  <n>       Number of nodes."
+       << endl
+       << "  <file>    Output graph file."
+       << endl << endl
+       << "Probabilities of edges that can be blocked are uniform in [l,u]."
+       << endl << endl;
+}
+
+int main(int argc, const char **argv) {
+    bool binary = false;
+    float certain = 0;
+    float lower = 0;
+    float upper = 1;
+    int seed = 0;
+
+    cout << "Arguments:";
+    for( int i = 0; i < argc; ++i ) {
+        cout << " " << argv[i];
+    }
+    cout << endl;
+
+    // parse arguments
+    ++argv;
+    --argc;
+    while( argc > 2 ) {
+        if( **argv != '-' ) break;
+        switch( (*argv)[1] ) {
+            case 'b':
+                binary = true;
+                ++argv;
+                --argc;
+                break;
+            case 'c':
+                certain = strtod(argv[1], 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'l':
+                lower = strtod(argv[1], 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 's':
+                seed = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'u':
+                upper = strtod(argv[1], 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            default:
+                usage(cout);
+                exit(-1);
+        }
+    }
+
+    if( argc != 2 ) {
+        usage(cout);
+        exit(-1);
+    }
+    int n = strtol(argv[0], 0, 0);
+    if( n < 3 ) {
+        cout << "error: number of nodes must be >= 3" << endl;
+        exit(-1);
+    }
+    if( (lower < 0) || (upper > 1) || (lower > upper) ) {
+        cout << "error: probability bounds must satisfy 0 <= l <= u <= 1" << endl;
+        exit(-1);
+    }
+
+    // place nodes; start and goal are closest to (0,0) and (side,side)
+    Random::set_seed(seed);
+    double side = 10 * sqrt((double)n);
+    vector<point_t> points;
+    for( int i = 0; i < n; ++i )
+        points.push_back(point_t(side * Random::real(), side * Random::real()));
+    int start = 0, goal = 0;
+    for( int i = 0; i < n; ++i ) {
+        if( points[i].x_ + points[i].y_ < points[start].x_ + points[start].y_ ) start = i;
+        if( points[i].x_ + points[i].y_ > points[goal].x_ + points[goal].y_ ) goal = i;
+    }
+    swap(points[0], points[start]);
+    if( goal == 0 ) goal = start;
+    swap(points[n - 1], points[goal]);
+
+    vector<pair<int, int> > edges;
+    delaunay(points, edges);
+    int connected = reachable(n, edges);
+    if( connected < n ) cout << "warning: only " << connected << " of " << n << " nodes are connected" << endl;
+
+    CTP::graph_t graph;
+    graph.reset(n);
+    for( size_t i = 0; i < edges.size(); ++i ) {
+        const point_t &p1 = points[edges[i].first], &p2 = points[edges[i].second];
+        int cost = (int)lround(hypot(p1.x_ - p2.x_, p1.y_ - p2.y_));
+        float prob = Random::real() < certain ? 1 : lower + (upper - lower) * Random::real();
+        graph.add_edge(CTP::graph_t::edge_t(edges[i].first, edges[i].second, cost < 1 ? 1 : cost, prob));
+    }
+
+    bool written = false;
+    if( binary ) {
+        written = graph.write_binary(argv[1]);
+    } else {
+        ofstream os(argv[1], ofstream::out);
+        graph.write_text(os);
+        written = os.good();
+    }
+    if( !written ) {
+        cout << "error: cannot write '" << argv[1] << "'" << endl;
+        exit(-1);
+    }
+    cout << "info: #nodes=" << graph.num_nodes_
+         << ", #edges=" << graph.num_edges_
+         << ", degree=" << graph.degree()
+         << ", max-cost=" << graph.max_cost_
+         << endl;
+
+    exit(0);
+}
+
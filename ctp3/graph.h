@@ -1,22 +1,106 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <string>
 #include <vector>
-#include <queue>
+#include <fcntl.h>
 #include <limits.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FW_TILE 32 // tile size of blocked Floyd-Warshall's
+
+// Largest graph (in nodes) for which the n x n matrices (edge index and
+// all-pairs distances) are built; larger graphs get the optimistic
+// distances to the goal from Dijkstra's and do without the rest.
+#ifndef CTP_MAX_ALL_PAIRS
+#define CTP_MAX_ALL_PAIRS 2048
+#endif
 
 namespace CTP {
 
-struct open_list_cmp {
-    bool operator()(const std::pair<int, int> &p1, const std::pair<int, int> &p2) {
-        return p1.second > p2.second;
+// Edge bitmaps (known and blocked edges) are arrays of 64-bit words;
+// edge e is bit e&63 of word e>>6.
+typedef unsigned long long word_t;
+
+// Scratch space for searches over a graph: a bucket queue for integer
+// keys (Dial's algorithm) plus per-node costs and closed marks. Searches
+// take the space from the caller and are thus reentrant. Keys pushed
+// while the minimum key is k must lie in [k,k+#buckets), so entries are
+// stored modulo the number of buckets (a power of two). Stale entries are
+// skipped when popped (lazy deletion). Repairs of distances use a binary
+// heap instead since their initial keys are not bounded that way.
+struct search_space_t {
+    std::vector<std::vector<int> > buckets_;
+    std::vector<int> g_;
+    std::vector<unsigned char> closed_;
+    std::vector<std::pair<int, int> > heap_;
+    std::vector<int> affected_;
+    unsigned size_;
+    unsigned mask_;
+    int key_;
+
+    search_space_t() : size_(0), mask_(0), key_(0) { }
+
+    void initialize(int num_nodes, int min_buckets) {
+        if( (int)g_.size() != num_nodes ) {
+            g_.resize(num_nodes);
+            closed_.resize(num_nodes);
+        }
+        unsigned num_buckets = 1;
+        while( (int)num_buckets < min_buckets ) num_buckets = num_buckets << 1;
+        if( buckets_.size() != num_buckets ) {
+            clear();
+            buckets_.resize(num_buckets);
+            mask_ = num_buckets - 1;
+        }
+        clear();
+    }
+    void clear() {
+        if( size_ > 0 ) {
+            for( int i = 0, isz = buckets_.size(); i < isz; ++i )
+                buckets_[i].clear();
+            size_ = 0;
+        }
     }
-};
 
-struct bfs_open_list_cmp {
-    bool operator()(const std::pair<int, std::pair<int, int> > &p1, const std::pair<int, std::pair<int, int> > &p2) {
-        return p1.second.first + p1.second.second > p2.second.first + p2.second.second;
+    bool empty() const { return size_ == 0; }
+    void push(int node, int key) {
+        buckets_[key & mask_].push_back(node);
+        ++size_;
+    }
+    // returns node in bucket of minimum key and sets key_ to that key
+    int pop() {
+        assert(size_ > 0);
+        std::vector<int> *bucket = &buckets_[key_ & mask_];
+        while( bucket->empty() ) {
+            ++key_;
+            bucket = &buckets_[key_ & mask_];
+        }
+        int node = bucket->back();
+        bucket->pop_back();
+        --size_;
+        return node;
     }
 };
 
+// Binary graph files hold a header followed by one record per edge with
+// its 0-based end nodes, cost and probability of being traversable, all
+// 32-bit values in host byte order. Records have the layout of edge_t,
+// so files can be mapped and read in place.
+struct binary_header_t {
+    char magic_[4];    // "CTPG"
+    uint32_t version_; // 1
+    uint32_t num_nodes_;
+    uint32_t num_edges_;
+};
+
 struct graph_t {
     int num_nodes_;
     int num_edges_;
@@ -31,23 +115,53 @@ struct graph_t {
           : from_(from), to_(to), cost_(cost), prob_(prob) { }
     };
 
+    // Compressed (CSR) adjacency used by the searches: the arcs of node n
+    // are arcs_[first_[n]] to arcs_[first_[n+1]-1], each with neighbour,
+    // cost, and the word and bit of its edge in the state bitmaps. Arcs of
+    // a node are sorted by edge, so a scan reads the bitmaps once per word
+    // and relaxes the arcs from one contiguous block.
+    struct arc_t {
+        int node_;
+        int cost_;
+        int word_;
+        word_t bit_;
+    };
+
     std::vector<edge_t> edge_list_;
     std::vector<std::vector<int> > at_;
+    std::vector<int> first_;
+    std::vector<arc_t> arcs_;
     int *edges_;
     int *h_opt_;
-    int *in_queue_;
+    int *d_opt_;
+    int *d_pes_;
+    int max_cost_;
 
     graph_t(bool with_shortcut = false, int shortcut_cost = 1000)
       : num_nodes_(0), num_edges_(0),
         with_shortcut_(with_shortcut), shortcut_cost_(shortcut_cost),
-        edges_(0), h_opt_(0), in_queue_(0) { }
+        edges_(0), h_opt_(0), d_opt_(0), d_pes_(0), max_cost_(0) { }
     ~graph_t() {
         delete[] edges_;
         delete[] h_opt_;
-        delete[] in_queue_;
+        delete[] d_opt_;
+        delete[] d_pes_;
+    }
+
+    // keys in the open lists of dijkstra() and bfs() span at most
+    // max-cost and 2*max-cost, respectively (h_opt_ is consistent)
+    int num_buckets() const { return 2 * max_cost_ + 1; }
+
+    // scratch space of the calling thread for searches that are not
+    // given one
+    search_space_t& thread_search_space() const {
+        static thread_local search_space_t space;
+        return space;
     }
 
     int heuristic(int node) const { return h_opt_[node]; }
+    int optimistic_distance(int n1, int n2) const { return d_opt_[n1*num_nodes_ + n2]; }
+    int pessimistic_distance(int n1, int n2) const { return d_pes_[n1*num_nodes_ + n2]; }
     int from(int edge) const { return edge_list_[edge].from_; }
     int to(int edge) const { return edge_list_[edge].to_; }
     int cost(int edge) const { return edge_list_[edge].cost_; }
@@ -63,34 +177,67 @@ struct graph_t {
         return d;
     }
 
+    bool has_all_pairs() const { return d_opt_ != 0; }
+
+    // empties the graph and sets its number of nodes
+    void reset(int num_nodes) {
+        num_nodes_ = num_nodes;
+        num_edges_ = 0;
+        max_cost_ = 0;
+        edge_list_.clear();
+        at_.assign(num_nodes_, std::vector<int>());
+    }
+
     int add_edge(const edge_t &edge) {
         assert((int)edge_list_.size() == num_edges_);
         edge_list_.push_back(edge);
         at_[edge.from_].push_back(num_edges_);
         at_[edge.to_].push_back(num_edges_);
-        edges_[edge.from_ * num_nodes_ + edge.to_] = num_edges_;
-        edges_[edge.to_ * num_nodes_ + edge.from_] = num_edges_;
+        max_cost_ = edge.cost_ > max_cost_ ? edge.cost_ : max_cost_;
         return num_edges_++;
     }
 
-    bool parse(std::istream &is) {
-        // read graph from file
-        edge_list_.clear();
-        at_.clear();
+    // builds the CSR adjacency from at_; called once all edges are added
+    void compile_adjacency() {
+        first_.assign(1, 0);
+        arcs_.clear();
+        arcs_.reserve(2 * num_edges_);
+        for( int node = 0; node < num_nodes_; ++node ) {
+            std::vector<int> edges(at_[node]);
+            std::sort(edges.begin(), edges.end());
+            for( int i = 0, isz = edges.size(); i < isz; ++i ) {
+                const edge_t &edge = edge_list_[edges[i]];
+                arc_t arc;
+                arc.node_ = node == edge.to_ ? edge.from_ : edge.to_;
+                arc.cost_ = edge.cost_;
+                arc.word_ = edges[i] >> 6;
+                arc.bit_ = word_t(1) << (edges[i] & 0x3F);
+                arcs_.push_back(arc);
+            }
+            first_.push_back(arcs_.size());
+        }
+    }
+
+    // distances are int sums and Floyd-Warshall's tables use INF =
+    // INT_MAX/2, so every simple path, which has at most num_nodes-1
+    // edges, must cost less than INT_MAX/2
+    bool path_costs_fit(int num_nodes, int max_cost) const {
+        long long cost = with_shortcut_ && (shortcut_cost_ > max_cost) ? shortcut_cost_ : max_cost;
+        long long bound = (long long)(num_nodes - 1) * cost;
+        if( bound < INT_MAX / 2 ) return true;
+        std::cout << "error reading input file: paths may cost up to " << bound
+                  << " (must be below " << INT_MAX / 2 << ")." << std::endl;
+        return false;
+    }
 
+    // reads the edges of a graph in text format
+    bool read_text(std::istream &is) {
         std::string token;
         is >> token;
         if( token == "p" ) {
-            int n_edges;
-            is >> num_nodes_ >> n_edges;
-
-            edges_ = new int[num_nodes_ * num_nodes_];
-            for( int n1 = 0; n1 < num_nodes_; ++n1 ) {
-                for( int n2 = 0; n2 < num_nodes_; ++n2 )
-                    edges_[n1*num_nodes_ + n2] = -1;
-            }
-
-            at_.resize(num_nodes_);
+            int num_nodes, n_edges;
+            is >> num_nodes >> n_edges;
+            reset(num_nodes);
             for( int e = 0; e < n_edges; ++e ) {
                 is >> token;
                 if( token == "e" ) {
@@ -105,11 +252,117 @@ struct graph_t {
                     return false;
                 }
             }
+            if( !path_costs_fit(num_nodes_, max_cost_) ) return false;
         } else {
             std::cout << "error reading input file: file doesn't start with 'p'." << std::endl;
             return false;
         }
+        return true;
+    }
 
+    // limits accepted by read_binary()
+    static const uint32_t max_binary_nodes = 1 << 24;
+    static const int max_binary_cost = 1 << 20;
+
+    // reads the edges of a graph in binary format from a mapped file
+    bool read_binary(const std::string &filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat st;
+        if( (fd == -1) || (fstat(fd, &st) == -1) ) {
+            std::cout << "error reading input file: cannot open '" << filename << "'." << std::endl;
+            if( fd != -1 ) close(fd);
+            return false;
+        }
+        size_t size = st.st_size;
+        void *data = size < sizeof(binary_header_t) ? MAP_FAILED : mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if( data == MAP_FAILED ) {
+            std::cout << "error reading input file: cannot map '" << filename << "'." << std::endl;
+            return false;
+        }
+
+        static_assert(sizeof(edge_t) == 16, "edge_t must match binary edge records");
+        bool ok = true;
+        const binary_header_t *header = static_cast<const binary_header_t*>(data);
+        const edge_t *edges = reinterpret_cast<const edge_t*>(header + 1);
+        if( (memcmp(header->magic_, "CTPG", 4) != 0) || (header->version_ != 1) ) {
+            std::cout << "error reading input file: bad header in binary file." << std::endl;
+            ok = false;
+        } else if( size != sizeof(binary_header_t) + header->num_edges_ * sizeof(edge_t) ) {
+            std::cout << "error reading input file: binary file has wrong size." << std::endl;
+            ok = false;
+        } else if( (header->num_nodes_ < 2) || (header->num_nodes_ > max_binary_nodes) ) {
+            std::cout << "error reading input file: binary file has " << header->num_nodes_
+                      << " nodes (must be in [2," << max_binary_nodes << "])." << std::endl;
+            ok = false;
+        } else {
+            // edges are checked before reset() so that a bad file leaves
+            // the graph untouched; the cost bound limits the buckets of the
+            // searches, and path_costs_fit() the sums of costs
+            int num_nodes = header->num_nodes_;
+            int max_cost = 0;
+            for( size_t e = 0; ok && (e < header->num_edges_); ++e ) {
+                const edge_t &edge = edges[e];
+                if( (edge.from_ < 0) || (edge.from_ >= num_nodes) ||
+                    (edge.to_ < 0) || (edge.to_ >= num_nodes) ) {
+                    std::cout << "error reading input file: edge " << e << " has bad end nodes." << std::endl;
+                    ok = false;
+                } else if( (edge.cost_ < 1) || (edge.cost_ > max_binary_cost) ) {
+                    std::cout << "error reading input file: edge " << e << " has cost " << edge.cost_
+                              << " (must be in [1," << max_binary_cost << "])." << std::endl;
+                    ok = false;
+                } else if( !((edge.prob_ >= 0) && (edge.prob_ <= 1)) ) {
+                    std::cout << "error reading input file: edge " << e << " has probability " << edge.prob_
+                              << " (must be in [0,1])." << std::endl;
+                    ok = false;
+                }
+                max_cost = edge.cost_ > max_cost ? edge.cost_ : max_cost;
+            }
+            if( ok ) ok = path_costs_fit(num_nodes, max_cost);
+            if( ok ) {
+                reset(num_nodes);
+                edge_list_.reserve(header->num_edges_);
+                for( size_t e = 0; e < header->num_edges_; ++e )
+                    add_edge(edges[e]);
+            }
+        }
+        munmap(data, size);
+        return ok;
+    }
+
+    static bool is_binary(const std::string &filename) {
+        char magic[4];
+        std::ifstream is(filename.c_str(), std::ifstream::binary);
+        return is.read(magic, 4) && (memcmp(magic, "CTPG", 4) == 0);
+    }
+
+    void write_text(std::ostream &os) const {
+        os << "p " << num_nodes_ << " " << num_edges_ << std::endl;
+        std::streamsize precision = os.precision(9);
+        for( int e = 0; e < num_edges_; ++e ) {
+            const edge_t &edge = edge_list_[e];
+            os << "e " << 1 + edge.from_ << " " << 1 + edge.to_
+               << " " << edge.prob_ << " " << edge.cost_ << std::endl;
+        }
+        os.precision(precision);
+    }
+
+    bool write_binary(const std::string &filename) const {
+        binary_header_t header;
+        memcpy(header.magic_, "CTPG", 4);
+        header.version_ = 1;
+        header.num_nodes_ = num_nodes_;
+        header.num_edges_ = num_edges_;
+        std::ofstream os(filename.c_str(), std::ofstream::binary);
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if( num_edges_ > 0 )
+            os.write(reinterpret_cast<const char*>(&edge_list_[0]), num_edges_ * sizeof(edge_t));
+        return os.good();
+    }
+
+    // adds the shortcut and builds the structures used by the searches;
+    // called once all edges are read
+    void preprocess() {
         // insert shortcut (s,t) edge
         if( with_shortcut_ ) {
             std::cout << "info: adding (s,t) shortcut w/ cost " << shortcut_cost_ << std::endl;
@@ -121,57 +374,96 @@ struct graph_t {
                   << ", degree=" << degree()
                   << std::endl;
 
-        // compute optimistic shortest-paths to goal
+        compile_adjacency();
+
+        int num_words = 1 + (num_edges_ >> 6);
+        std::vector<word_t> unknown(num_words, 0), known(num_words, ~word_t(0)), uncertain(num_words, 0);
         h_opt_ = new int[num_nodes_];
-        in_queue_ = new int[num_nodes_];
-        for( int node = 0; node < num_nodes_; ++node )
-            h_opt_[node] = INT_MAX;
-
-        std::priority_queue<std::pair<int, int>,
-                            std::vector<std::pair<int, int> >,
-                            open_list_cmp> queue;
-
-        int goal = num_nodes_ - 1;
-        h_opt_[goal] = 0;
-        queue.push(std::make_pair(goal, 0));
-        while( !queue.empty() ) {
-            std::pair<int, int> p = queue.top();
-            queue.pop();
-            if( p.second <= h_opt_[p.first] ) {
-                for( int i = 0, isz = at_[p.first].size(); i < isz; ++i ) {
-                    const edge_t &e = edge_list_[at_[p.first][i]];
-                    int cost = p.second + e.cost_;
-                    int to = e.from_ == p.first ? e.to_ : e.from_;
-                    if( cost < h_opt_[to] ) {
-                        h_opt_[to] = cost;
-                        queue.push(std::make_pair(to, cost));
-                    }
-                }
-            }
+        if( num_nodes_ > CTP_MAX_ALL_PAIRS ) {
+            std::cout << "info: no all-pairs distances for more than " << CTP_MAX_ALL_PAIRS << " nodes" << std::endl;
+            dijkstra(num_nodes_ - 1, h_opt_, &unknown[0], &unknown[0], true);
+            return;
         }
 
+        edges_ = new int[num_nodes_ * num_nodes_];
+        for( int n1 = 0; n1 < num_nodes_; ++n1 ) {
+            for( int n2 = 0; n2 < num_nodes_; ++n2 )
+                edges_[n1*num_nodes_ + n2] = -1;
+        }
+        for( int e = 0; e < num_edges_; ++e ) {
+            edges_[from(e) * num_nodes_ + to(e)] = e;
+            edges_[to(e) * num_nodes_ + from(e)] = e;
+        }
+
+        // all-pairs distances when every edge is traversable (optimistic)
+        // and when only those that cannot be blocked are: edges of
+        // probability 1 other than the shortcut, which weather sampling
+        // marks as blocked (pessimistic)
+        for( int e = 0; e < num_edges_; ++e ) {
+            if( (prob(e) < 1) || (with_shortcut_ && (e == num_edges_ - 1)) )
+                uncertain[e >> 6] |= word_t(1) << (e & 0x3F);
+        }
+        d_opt_ = new int[num_nodes_ * num_nodes_];
+        floyd_warshall(d_opt_, &unknown[0], &unknown[0], true);
+        d_pes_ = new int[num_nodes_ * num_nodes_];
+        floyd_warshall(d_pes_, &known[0], &uncertain[0], false);
+
+        // optimistic shortest-paths to goal
+        for( int node = 0; node < num_nodes_; ++node )
+            h_opt_[node] = optimistic_distance(node, num_nodes_ - 1);
+    }
+
+    bool parse(std::istream &is) {
+        if( !read_text(is) ) return false;
+        preprocess();
         return true;
     }
 
-    bool known(int edge, const unsigned *bitmap) const {
-        int n = edge >> 5, offset = edge & 0x1F;
-        int mask = 1 << offset;
-        return bitmap[n] & mask;
+    // reads a graph file in either format and preprocesses it
+    bool load(const std::string &filename) {
+        if( is_binary(filename) ) {
+            if( !read_binary(filename) ) return false;
+        } else {
+            std::ifstream is(filename.c_str(), std::ifstream::in);
+            if( !read_text(is) ) return false;
+        }
+        preprocess();
+        return true;
+    }
+
+    bool known(int edge, const word_t *bitmap) const {
+        return ((bitmap[edge >> 6] >> (edge & 0x3F)) & 1) != 0;
     }
-    bool traversable(int edge, const unsigned *bitmap) const {
-        int n = edge >> 5, offset = edge & 0x1F;
-        int mask = 1 << offset;
-        return (bitmap[n] & mask) != 0 ? false : true;
+    bool traversable(int edge, const word_t *bitmap) const {
+        return ((bitmap[edge >> 6] >> (edge & 0x3F)) & 1) == 0;
     }
-    bool good(int edge, const unsigned *k_bitmap, const unsigned *b_bitmap, bool optimistic) const {
+    bool good(int edge, const word_t *k_bitmap, const word_t *b_bitmap, bool optimistic) const {
         return (known(edge, k_bitmap) && traversable(edge, b_bitmap)) ||
                (optimistic && !known(edge, k_bitmap));
     }
+    // bits of the good edges among those of the given bitmap word
+    word_t good_bits(int word, const word_t *k_bitmap, const word_t *b_bitmap, bool optimistic) const {
+        return optimistic ? ~(k_bitmap[word] & b_bitmap[word]) : k_bitmap[word] & ~b_bitmap[word];
+    }
+    bool good(const arc_t &arc, const word_t *k_bitmap, const word_t *b_bitmap, bool optimistic) const {
+        return (good_bits(arc.word_, k_bitmap, b_bitmap, optimistic) & arc.bit_) != 0;
+    }
+    const arc_t* arcs_begin(int node) const { return arcs_.data() + first_[node]; }
+    const arc_t* arcs_end(int node) const { return arcs_.data() + first_[node + 1]; }
+
     int edge(int n1, int n2,
-             const unsigned *k_bitmap,
-             const unsigned *b_bitmap,
+             const word_t *k_bitmap,
+             const word_t *b_bitmap,
              bool optimistic) const {
-        int edge = edges_[n1*num_nodes_ + n2];
+        int edge = -1;
+        if( edges_ != 0 ) {
+            edge = edges_[n1*num_nodes_ + n2];
+        } else {
+            for( int i = 0, isz = at_[n1].size(); i < isz; ++i ) {
+                int e = at_[n1][i];
+                if( (from(e) == n2) || (to(e) == n2) ) edge = e;
+            }
+        }
         if( edge != -1 ) {
             return good(edge, k_bitmap, b_bitmap, optimistic) ? edge : -1;
         } else {
@@ -179,114 +471,300 @@ struct graph_t {
         }
     }
 
+    // A* search for a cheapest path from start to goal guided by the
+    // optimistic distances h_opt_; returns INT_MAX if there is no path
     int bfs(int start,
             int goal,
-            const unsigned *k_bitmap,
-            const unsigned *b_bitmap,
-            bool optimistic = false) const {
+            const word_t *k_bitmap,
+            const word_t *b_bitmap,
+            bool optimistic,
+            search_space_t &space) const {
 
-        static std::priority_queue<std::pair<int, std::pair<int, int> >,
-                                   std::vector<std::pair<int, std::pair<int, int> > >,
-                                   bfs_open_list_cmp> queue;
+        if( heuristic(start) == INT_MAX ) return INT_MAX;
+
+        space.initialize(num_nodes_, num_buckets());
+        for( int node = 0; node < num_nodes_; ++node ) {
+            space.g_[node] = INT_MAX;
+            space.closed_[node] = 0;
+        }
 
         int cost_to_goal = INT_MAX;
-        memset(in_queue_, 0, num_nodes_ * sizeof(int));
-        queue.push(std::make_pair(start, std::make_pair(0, heuristic(start))));
-        in_queue_[start] = 1;
-        while( !queue.empty() ) {
-            std::pair<int, std::pair<int, int> > p = queue.top();
-            queue.pop();
-
-            if( p.first == goal ) {
-                cost_to_goal = p.second.first;
+        space.g_[start] = 0;
+        space.key_ = heuristic(start);
+        space.push(start, space.key_);
+        while( !space.empty() ) {
+            int node = space.pop();
+            if( space.closed_[node] || (space.g_[node] + heuristic(node) != space.key_) )
+                continue;
+
+            if( node == goal ) {
+                cost_to_goal = space.g_[node];
                 break;
             }
 
-            for( int i = 0, isz = at_[p.first].size(); i < isz; ++i ) {
-                int idx = at_[p.first][i];
-                if( good(idx, k_bitmap, b_bitmap, optimistic) ) {
-                    const edge_t &edge = edge_list_[idx];
-                    int cost = p.second.first + edge.cost_;
-                    int next = p.first == edge.to_ ? edge.from_ : edge.to_;
-                    if( in_queue_[next] == 0 ) {
-                        queue.push(std::make_pair(next, std::make_pair(cost, heuristic(next))));
-                        in_queue_[next] = 1;
+            space.closed_[node] = 1;
+            const arc_t *arc = arcs_begin(node), *end = arcs_end(node);
+            while( arc != end ) {
+                int word = arc->word_;
+                word_t usable = good_bits(word, k_bitmap, b_bitmap, optimistic);
+                for( ; (arc != end) && (arc->word_ == word); ++arc ) {
+                    if( (usable & arc->bit_) == 0 ) continue;
+                    int next = arc->node_;
+                    if( space.closed_[next] || (heuristic(next) == INT_MAX) ) continue;
+                    int cost = space.g_[node] + arc->cost_;
+                    if( cost < space.g_[next] ) {
+                        space.g_[next] = cost;
+                        space.push(next, cost + heuristic(next));
                     }
                 }
             }
         }
 
-        while( !queue.empty() ) queue.pop();
+        space.clear();
         return cost_to_goal;
     }
+    int bfs(int start,
+            int goal,
+            const word_t *k_bitmap,
+            const word_t *b_bitmap,
+            bool optimistic = false) const {
+        return bfs(start, goal, k_bitmap, b_bitmap, optimistic, thread_search_space());
+    }
 
+    // Dijkstra's algorithm from source over the good edges
     void dijkstra(int source,
                   int *distances,
-                  const unsigned *k_bitmap,
-                  const unsigned *b_bitmap,
-                  bool optimistic = false) const {
-
-        static std::priority_queue<std::pair<int, int>,
-                                   std::vector<std::pair<int, int> >,
-                                   open_list_cmp> queue;
+                  const word_t *k_bitmap,
+                  const word_t *b_bitmap,
+                  bool optimistic,
+                  search_space_t &space) const {
 
         // initialization
+        space.initialize(num_nodes_, num_buckets());
         for( int node = 0; node < num_nodes_; ++node )
             distances[node] = INT_MAX;
 
         // Dijsktra's
         distances[source] = 0;
-        queue.push(std::make_pair(source, 0));
-        while( !queue.empty() ) {
-            std::pair<int, int> p = queue.top();
-            queue.pop();
-            if( p.second <= distances[p.first] ) {
-                for( int i = 0, isz = at_[p.first].size(); i < isz; ++i ) {
-                    int idx = at_[p.first][i];
-                    if( good(idx, k_bitmap, b_bitmap, optimistic) ) {
-                        const edge_t &edge = edge_list_[idx];
-                        int cost = p.second + edge.cost_;
-                        int next = p.first == edge.to_ ? edge.from_ : edge.to_;
-                        if( cost < distances[next] ) {
-                            distances[next] = cost;
-                            queue.push(std::make_pair(next, cost));
-                        }
+        space.key_ = 0;
+        space.push(source, 0);
+        while( !space.empty() ) {
+            int node = space.pop();
+            if( distances[node] != space.key_ ) continue;
+            const arc_t *arc = arcs_begin(node), *end = arcs_end(node);
+            while( arc != end ) {
+                int word = arc->word_;
+                word_t usable = good_bits(word, k_bitmap, b_bitmap, optimistic);
+                for( ; (arc != end) && (arc->word_ == word); ++arc ) {
+                    if( (usable & arc->bit_) == 0 ) continue;
+                    int cost = space.key_ + arc->cost_;
+                    if( cost < distances[arc->node_] ) {
+                        distances[arc->node_] = cost;
+                        space.push(arc->node_, cost);
                     }
                 }
             }
         }
     }
+    void dijkstra(int source,
+                  int *distances,
+                  const word_t *k_bitmap,
+                  const word_t *b_bitmap,
+                  bool optimistic = false) const {
+        dijkstra(source, distances, k_bitmap, b_bitmap, optimistic, thread_search_space());
+    }
+
+    // Repairs the distances to (or from) a root after the edges in
+    // removed became unavailable. On entry, distances hold the values
+    // before the removal; the bitmaps describe the graph after it. Nodes
+    // whose shortest paths used a removed edge are found in increasing
+    // order of old distance (a node is affected if it has no tight edge to
+    // an unaffected node), and only those are recomputed with Dijkstra
+    // seeded from their unaffected neighbours. Edge costs are positive.
+    void repair(int *distances,
+                const std::vector<int> &removed,
+                const word_t *k_bitmap,
+                const word_t *b_bitmap,
+                bool optimistic,
+                search_space_t &space) const {
+
+        // closed_: 0 = untouched, 1 = candidate, 2 = affected
+        std::greater<std::pair<int, int> > cmp;
+        std::vector<std::pair<int, int> > &heap = space.heap_;
+        space.initialize(num_nodes_, num_buckets());
+        std::fill(space.closed_.begin(), space.closed_.end(), 0);
+        space.affected_.clear();
+        heap.clear();
+
+        // candidates are the far endpoints of removed tight edges
+        for( int i = 0, isz = removed.size(); i < isz; ++i ) {
+            const edge_t &edge = edge_list_[removed[i]];
+            int u = edge.from_, v = edge.to_;
+            if( (distances[u] == INT_MAX) || (distances[v] == INT_MAX) ) continue;
+            int far = distances[u] == distances[v] + edge.cost_ ? u :
+                      (distances[v] == distances[u] + edge.cost_ ? v : -1);
+            if( (far != -1) && (space.closed_[far] == 0) ) {
+                space.closed_[far] = 1;
+                heap.push_back(std::make_pair(distances[far], far));
+                std::push_heap(heap.begin(), heap.end(), cmp);
+            }
+        }
 
+        // find affected nodes
+        while( !heap.empty() ) {
+            int node = heap.front().second;
+            std::pop_heap(heap.begin(), heap.end(), cmp);
+            heap.pop_back();
+
+            bool supported = false;
+            for( const arc_t *arc = arcs_begin(node), *end = arcs_end(node); !supported && (arc != end); ++arc ) {
+                if( good(*arc, k_bitmap, b_bitmap, optimistic) ) {
+                    int next = arc->node_;
+                    supported = (space.closed_[next] != 2) && (distances[next] != INT_MAX) &&
+                                (distances[next] + arc->cost_ == distances[node]);
+                }
+            }
+            if( supported ) continue;
+
+            space.closed_[node] = 2;
+            space.affected_.push_back(node);
+            for( const arc_t *arc = arcs_begin(node), *end = arcs_end(node); arc != end; ++arc ) {
+                if( good(*arc, k_bitmap, b_bitmap, optimistic) ) {
+                    int next = arc->node_;
+                    if( (space.closed_[next] == 0) && (distances[next] != INT_MAX) &&
+                        (distances[next] == distances[node] + arc->cost_) ) {
+                        space.closed_[next] = 1;
+                        heap.push_back(std::make_pair(distances[next], next));
+                        std::push_heap(heap.begin(), heap.end(), cmp);
+                    }
+                }
+            }
+        }
+
+        // seed affected nodes from their unaffected neighbours
+        for( int i = 0, isz = space.affected_.size(); i < isz; ++i ) {
+            int node = space.affected_[i];
+            int best = INT_MAX;
+            for( const arc_t *arc = arcs_begin(node), *end = arcs_end(node); arc != end; ++arc ) {
+                if( good(*arc, k_bitmap, b_bitmap, optimistic) ) {
+                    int next = arc->node_;
+                    if( (space.closed_[next] != 2) && (distances[next] != INT_MAX) &&
+                        (distances[next] + arc->cost_ < best) ) {
+                        best = distances[next] + arc->cost_;
+                    }
+                }
+            }
+            distances[node] = best;
+            if( best != INT_MAX ) {
+                heap.push_back(std::make_pair(best, node));
+                std::push_heap(heap.begin(), heap.end(), cmp);
+            }
+        }
+
+        // Dijkstra's restricted to affected nodes
+        while( !heap.empty() ) {
+            std::pair<int, int> p = heap.front();
+            std::pop_heap(heap.begin(), heap.end(), cmp);
+            heap.pop_back();
+            if( p.first != distances[p.second] ) continue;
+            for( const arc_t *arc = arcs_begin(p.second), *end = arcs_end(p.second); arc != end; ++arc ) {
+                if( good(*arc, k_bitmap, b_bitmap, optimistic) ) {
+                    int next = arc->node_;
+                    int cost = p.first + arc->cost_;
+                    if( (space.closed_[next] == 2) && (cost < distances[next]) ) {
+                        distances[next] = cost;
+                        heap.push_back(std::make_pair(cost, next));
+                        std::push_heap(heap.begin(), heap.end(), cmp);
+                    }
+                }
+            }
+        }
+    }
+
+    // whether some removed edge lies on a shortest path (is tight), i.e.
+    // whether repair() would change distances
+    bool tight(const int *distances, const std::vector<int> &removed) const {
+        for( int i = 0, isz = removed.size(); i < isz; ++i ) {
+            const edge_t &edge = edge_list_[removed[i]];
+            int u = edge.from_, v = edge.to_;
+            if( (distances[u] == INT_MAX) || (distances[v] == INT_MAX) ) continue;
+            if( (distances[u] == distances[v] + edge.cost_) || (distances[v] == distances[u] + edge.cost_) )
+                return true;
+        }
+        return false;
+    }
+    void repair(int *distances,
+                const std::vector<int> &removed,
+                const word_t *k_bitmap,
+                const word_t *b_bitmap,
+                bool optimistic = false) const {
+        repair(distances, removed, k_bitmap, b_bitmap, optimistic, thread_search_space());
+    }
+
+    // All-pairs distances over the good edges into the n x n matrix
+    // distances (INT_MAX if unreachable). Floyd-Warshall's is blocked into
+    // tiles that fit in L1: for each diagonal tile, the tile is closed
+    // first, then the tiles in its row and column, and then all others
+    // through it (a min-plus product). During the computation unreachable
+    // entries hold INF = INT_MAX/2, so that the sum of two entries never
+    // overflows and the inner loop is a branch-free add-and-min that the
+    // compiler vectorizes.
     void floyd_warshall(int *distances,
-                        const unsigned *k_bitmap,
-                        const unsigned *b_bitmap,
+                        const word_t *k_bitmap,
+                        const word_t *b_bitmap,
                         bool optimistic = false) const {
 
-        // initialization
-        for( int n = 0; n < num_nodes_ * num_nodes_; ++n ) {
-            distances[n] = INT_MAX;
-        }
-        for( int n = 0; n < num_nodes_; ++n ) {
-            distances[n*num_nodes_ + n] = 0;
+        // initialization; the matrix is padded to whole tiles with
+        // isolated nodes
+        const int INF = INT_MAX / 2;
+        int size = (num_nodes_ + FW_TILE - 1) / FW_TILE * FW_TILE;
+        std::vector<int> d(size * size, INF);
+        for( int n = 0; n < size; ++n ) {
+            d[n*size + n] = 0;
         }
         for( int e = 0; e < num_edges_; ++e ) {
             if( good(e, k_bitmap, b_bitmap, optimistic) ) {
                 int n1 = to(e), n2 = from(e), edge_cost = cost(e);
-                distances[n1*num_nodes_ + n2] = edge_cost;
-                distances[n2*num_nodes_ + n1] = edge_cost;
+                d[n1*size + n2] = edge_cost < d[n1*size + n2] ? edge_cost : d[n1*size + n2];
+                d[n2*size + n1] = d[n1*size + n2];
             }
         }
 
-        // Floyd-Warshall's
-        for( int k = 0; k < num_nodes_; ++k ) {
-            for( int i = 0; i < num_nodes_; ++i ) {
-                if( distances[i*num_nodes_+k] == INT_MAX ) continue;
-                for( int j = 0; j < num_nodes_; ++j ) {
-                    if( distances[k*num_nodes_+j] == INT_MAX ) continue;
-                    int ncost = distances[i*num_nodes_+k]+distances[k*num_nodes_+j];
-                    if( ncost < distances[i*num_nodes_+j] ) {
-                        distances[i*num_nodes_+j] = ncost;
-                    }
+        // Floyd-Warshall's over tiles
+        for( int k0 = 0; k0 < size; k0 += FW_TILE ) {
+            relax_tile(&d[0], size, k0, k0, k0);
+            for( int j0 = 0; j0 < size; j0 += FW_TILE ) {
+                if( j0 != k0 ) relax_tile(&d[0], size, k0, j0, k0);
+            }
+            for( int i0 = 0; i0 < size; i0 += FW_TILE ) {
+                if( i0 != k0 ) relax_tile(&d[0], size, i0, k0, k0);
+            }
+            for( int i0 = 0; i0 < size; i0 += FW_TILE ) {
+                if( i0 == k0 ) continue;
+                for( int j0 = 0; j0 < size; j0 += FW_TILE ) {
+                    if( j0 != k0 ) relax_tile(&d[0], size, i0, j0, k0);
+                }
+            }
+        }
+
+        for( int n1 = 0; n1 < num_nodes_; ++n1 ) {
+            for( int n2 = 0; n2 < num_nodes_; ++n2 ) {
+                int value = d[n1*size + n2];
+                distances[n1*num_nodes_ + n2] = value < INF ? value : INT_MAX;
+            }
+        }
+    }
+
+    // relaxes the tile at (i0,j0) through the nodes of the tile at k0
+    static void relax_tile(int *d, int size, int i0, int j0, int k0) {
+        for( int k = k0; k < k0 + FW_TILE; ++k ) {
+            const int *dk = d + k*size + j0;
+            for( int i = i0; i < i0 + FW_TILE; ++i ) {
+                int *di = d + i*size + j0;
+                int dik = d[i*size + k];
+                for( int j = 0; j < FW_TILE; ++j ) {
+                    int ncost = dik + dk[j];
+                    di[j] = ncost < di[j] ? ncost : di[j];
                 }
             }
         }
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <vector>
 
 #include "ctp3.h"
@@ -15,13 +16,90 @@ namespace Online {
 }
 #endif
 
+// sample a weather in which the goal is reachable
+void sample_good_weather(const CTP::graph_t &graph, state_t &hidden) {
+    sample_weather(graph, hidden);
+    //hidden.preprocess();
+    while( hidden.is_dead_end() ) {
+        sample_weather(graph, hidden);
+        //hidden.preprocess();
+    }
+    if( graph.with_shortcut_ ) hidden.set_edge_status(graph.num_edges_ - 1, false);
+}
+
+// run policy from start node under the hidden weather set in pwhs
+float evaluation_trial(const problem_with_hidden_state_t &pwhs,
+                       const Online::Policy::policy_t<state_t> &policy,
+                       unsigned max_depth,
+                       int shortcut_cost) {
+    size_t steps = 0;
+    float cost = 0;
+    state_t state = pwhs.init();
+    while( (steps < max_depth) && !pwhs.terminal(state) ) {
+        assert(!state.is_dead_end());
+        //cout << "state=" << state << " " << (state.is_dead_end() ? 1 : 0) << endl;
+        //cout << "dist=" << state.distances_ << endl;
+        Problem::action_t action = policy(state);
+        //cout << "act=" << action << endl;
+        assert(action != Problem::noop);
+        assert(policy.problem().applicable(state, action));
+        pair<state_t, bool> p = pwhs.sample(state, action);
+#if 1
+        if( pwhs.cost(state, action) == shortcut_cost ) {
+            cout << "large cost" << endl;
+        }
+#endif
+        cost += pwhs.cost(state, action);
+        state = p.first;
+        ++steps;
+    }
+    return cost;
+}
+
+// trials for paired evaluation: the weather is sampled from the
+// environment stream and the policy runs on the policy stream
+struct paired_trial_t {
+    const context_t &context_;
+    const problem_with_hidden_state_t &pwhs_;
+    const vector<const Online::Policy::policy_t<state_t>*> &policies_;
+    unsigned max_depth_;
+    int shortcut_cost_;
+    paired_trial_t(const context_t &context,
+                   const problem_with_hidden_state_t &pwhs,
+                   const vector<const Online::Policy::policy_t<state_t>*> &policies,
+                   unsigned max_depth,
+                   int shortcut_cost)
+      : context_(context), pwhs_(pwhs), policies_(policies),
+        max_depth_(max_depth), shortcut_cost_(shortcut_cost) { }
+    float operator()(size_t i,
+                     Random::state_t &environment,
+                     Random::state_t &policy_stream,
+                     bool antithetic) const {
+        state_t hidden(context_, 0);
+        Random::set_state(environment);
+        Random::set_antithetic(antithetic);
+        sample_good_weather(context_.graph_, hidden);
+        Random::set_antithetic(false);
+        environment = Random::get_state();
+        pwhs_.set_hidden(hidden);
+        Random::set_state(policy_stream);
+        float cost = evaluation_trial(pwhs_, *policies_[i], max_depth_, shortcut_cost_);
+        policy_stream = Random::get_state();
+        return cost;
+    }
+};
+
 void usage(ostream &os) {
-    os << "usage: ctp3 [-a <n>] [-b <n>] [-e <f>] [-f] [-g <f>] [-h <n>] [-s <n>] <file>"
+    os << "usage: ctp3 [-a <n>] [-A] [-b <n>] [-D <n>] [-e <f>] [-f] [-g <f>] [-h <n>] [-H <n>] [-L <file>] [-M <n>] [-P <file>] [-r <f>] [-s <n>] [-S <file>] <file>"
        << endl << endl
        << "  -a <n>    Algorithm bitmask: 1=vi, 2=slrtdp, 4=ulrtdp, 8=blrtdp, 16=ilao, 32=plain-check, 64=elrtdp, 128=hdp-i, 256=hdp, 512=ldfs+, 1024=ldfs."
        << endl
+       << "  -A        Antithetic trials in paired evaluation."
+       << endl
        << "  -b <n>    Visits bound for blrtdp. Default: inf."
        << endl
+       << "  -D <n>    Capacity of cache for shortest-path distances (0=none). Default: 0."
+       << endl
        << "  -e <f>    Epsilon. Default: 0."
        << endl
        << "  -f        Formatted output."
@@ -30,15 +108,31 @@ void usage(ostream &os) {
        << endl
        << "  -h <n>    Heuristics: 0=zero, 1=minmin. Default: 0."
        << endl
+       << "  -H <n>    Capacity of cache for min-min heuristic (0=none). Default: 0."
+       << endl
+       << "  -L <file> Load value function from table file (used as 'optimal')."
+       << endl
+       << "  -M <n>    Capacity of memo of heuristic values by (node, blocked edges) (0=none). Default: 1e5."
+       << endl
 #if 0
        << "  -k <n>    Kappa consistency level. Default: 0."
        << endl
        << "  -K <f>    Used to define kappa measures. Default: 2."
        << endl
 #endif
+       << "  -P <file> Write compiled optimal policy into table file (load with -L)."
+       << endl
+       << "  -r <f>    Stop evaluation when 95% confidence half-width is <= f. Default: 0 (off)."
+       << endl
        << "  -s <n>    Random seed. Default: 0."
        << endl
-       << "  <file>    Racetrack file."
+       << "  -S <file> Save value function of first algorithm into table file."
+       << endl
+       << "  <file>    Graph file (text or binary)."
+       << endl << endl
+       << "Policy types and widths may be colon-separated lists; then, all combinations"
+       << endl
+       << "are compared with paired evaluation on the same sampled weathers."
        << endl << endl;
 }
 
@@ -49,12 +143,19 @@ int main(int argc, const char **argv) {
     int shortcut_cost = (int)5e3;
     float dead_end_value = 1e3;
     float heuristic_weight = 1.0;
+    size_t heuristic_cache = 0;
+    unsigned distances_cache = 0;
+    unsigned heuristic_memo = (unsigned)1e5;
 
     int calculate_feature = 0;
     int calculate_nsamples = 0;
 
     string base_name;
     string policy_type;
+    string load_file;
+    string save_file;
+    string policy_file;
+    string width_list;
     Online::Evaluation::parameters_t eval_pars;
 
     cout << fixed;
@@ -77,6 +178,11 @@ int main(int argc, const char **argv) {
                 argv += 2;
                 argc -= 2;
                 break;
+            case 'A':
+                eval_pars.antithetic_ = true;
+                ++argv;
+                --argc;
+                break;
             case 'b':
                 alg_pars.rtdp.bound_ = strtol(argv[1], 0, 0);
                 argv += 2;
@@ -98,6 +204,11 @@ int main(int argc, const char **argv) {
                 argv += 2;
                 argc -= 2;
                 break;
+            case 'D':
+                distances_cache = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
             case 'e':
                 alg_pars.epsilon_ = strtod(argv[1], 0);
                 argv += 2;
@@ -123,11 +234,41 @@ int main(int argc, const char **argv) {
                 ++argv;
                 --argc;
                 break;
+            case 'H':
+                heuristic_cache = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'L':
+                load_file = argv[1];
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'M':
+                heuristic_memo = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'P':
+                policy_file = argv[1];
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'r':
+                eval_pars.evaluation_precision_ = strtod(argv[1], 0);
+                argv += 2;
+                argc -= 2;
+                break;
             case 's':
                 alg_pars.seed_ = strtoul(argv[1], 0, 0);
                 argv += 2;
                 argc -= 2;
                 break;
+            case 'S':
+                save_file = argv[1];
+                argv += 2;
+                argc -= 2;
+                break;
             case 't':
                 eval_pars.evaluation_trials_ = strtoul(argv[1], 0, 0);
                 argv += 2;
@@ -150,13 +291,14 @@ int main(int argc, const char **argv) {
     }
 
     CTP::graph_t graph(false, shortcut_cost);
+    string graph_file;
     if( argc >= 3 ) {
-        ifstream is(argv[0], ifstream::in);
-        if( !graph.parse(is) ) exit(-1);
-        is.close();
+        graph_file = argv[0];
+        if( !graph.load(argv[0]) ) exit(-1);
         base_name = argv[1];
         policy_type = argv[2];
         if( argc >= 4 ) eval_pars.width_ = strtoul(argv[3], 0, 0);
+        if( argc >= 4 ) width_list = argv[3];
         if( argc >= 5 ) eval_pars.depth_ = strtoul(argv[4], 0, 0);
         if( argc >= 6 ) eval_pars.par1_ = strtod(argv[5], 0);
         if( argc >= 7 ) eval_pars.par2_ = strtoul(argv[6], 0, 0);
@@ -168,11 +310,12 @@ int main(int argc, const char **argv) {
     // build problem instances
     cout << "seed=" << alg_pars.seed_ << endl;
     Random::set_seed(alg_pars.seed_);
-    state_t::initialize(graph, false, (int)5e5);
-    problem_t problem(graph, dead_end_value, false, (int)5e5);
+    context_t context(graph, distances_cache > 0, distances_cache, heuristic_memo);
+    if( !context.check(cout) ) exit(1);
+    problem_t problem(context, dead_end_value, false, (int)5e5);
 
     if( (calculate_feature & 0x1) == 1 ) {
-        float probability = probability_bad_weather(graph, calculate_nsamples);
+        float probability = probability_bad_weather(context, calculate_nsamples);
         cout << "P(bad weather)=" << probability << endl;
     }
     if( (calculate_feature & 0x2) == 2 ) {
@@ -184,19 +327,25 @@ int main(int argc, const char **argv) {
     // create heuristics
     vector<pair<const Heuristic::heuristic_t<state_t>*, string> > heuristics;
     heuristics.push_back(make_pair(new Heuristic::zero_heuristic_t<state_t>, "zero"));
-    Heuristic::heuristic_t<state_t> *heuristic = new min_min_t;
+
+    // min-min values are already memoized by (node, blocked edges) with -M;
+    // the cache over whole states (-H) costs more than it saves by default
+    Heuristic::heuristic_t<state_t> *min_min = new min_min_t;
+    Heuristic::cached_heuristic_t<state_t> *min_min_cache = 0;
+    if( heuristic_cache > 0 ) {
+        min_min_cache = new Heuristic::cached_heuristic_t<state_t>(*min_min, heuristic_cache);
+        min_min = min_min_cache;
+    }
     if( heuristic_weight != 1.0 ) {
-        heuristic = new Heuristic::weighted_heuristic_t<state_t>(*heuristic, heuristic_weight);
+        min_min = new Heuristic::weighted_heuristic_t<state_t>(*min_min, heuristic_weight);
     }
-    heuristics.push_back(make_pair(heuristic, "min-min"));
+    heuristics.push_back(make_pair(min_min, "min-min"));
 
-    heuristic = 0;
+    Heuristic::heuristic_t<state_t> *heuristic = 0;
     if( h == 0 ) {
         heuristic = new Heuristic::zero_heuristic_t<state_t>;
     } else if( h == 1) {
-        heuristic = new min_min_t;
-        if( heuristic_weight != 1.0 )
-            heuristic = new Heuristic::weighted_heuristic_t<state_t>(*heuristic, heuristic_weight);
+        heuristic = min_min;
     }
 
     // solve problem with algorithms
@@ -211,13 +360,41 @@ int main(int argc, const char **argv) {
         }
     }
 
+    // save value function of first algorithm, or load it from file
+    ostringstream key;
+    key << "ctp3(graph=" << graph_file << ",dead-end-value=" << dead_end_value << ")";
+    if( !save_file.empty() && !results.empty() ) {
+        if( !results[0].hash_->save(save_file, key.str()) ) exit(-1);
+        cout << "table: saved " << results[0].hash_->size() << " states into '" << save_file << "'" << endl;
+    }
+    Table::table_t<state_t> table;
+    if( !load_file.empty() ) {
+        float start_time = Utils::read_time_in_seconds();
+        if( !table.map(load_file, key.str()) ) {
+            cout << "error: cannot load table from '" << load_file << "'" << endl;
+            exit(-1);
+        }
+        table.print_stats(cout);
+        cout << "table: load-time=" << Utils::read_time_in_seconds() - start_time << endl;
+        heuristics.push_back(make_pair(new Heuristic::table_heuristic_t<state_t>(table), "optimal"));
+    }
+
     // evaluate policies
     vector<pair<const Online::Policy::policy_t<state_t>*, string> > base_policies;
 
     // fill base policies
     const Problem::hash_t<state_t> *hash = results.empty() ? 0 : results[0].hash_;
+    Table::table_t<state_t> compiled;
     if( hash != 0 ) {
-        Online::Policy::hash_policy_t<state_t> optimal(*hash);
+        float start_time = Utils::read_time_in_seconds();
+        hash->compile(problem.init(), compiled, key.str());
+        cout << "compiled: #records=" << compiled.size()
+             << ", time=" << Utils::read_time_in_seconds() - start_time << endl;
+        if( !policy_file.empty() && !compiled.write(policy_file) ) exit(-1);
+        Online::Policy::table_policy_t<state_t> optimal(problem, compiled);
+        base_policies.push_back(make_pair(optimal.clone(), "optimal"));
+    } else if( !table.empty() ) {
+        Online::Policy::table_policy_t<state_t> optimal(problem, table);
         base_policies.push_back(make_pair(optimal.clone(), "optimal"));
     }
     if( heuristic != 0 ) {
@@ -235,76 +412,103 @@ int main(int argc, const char **argv) {
     Online::Evaluation::global_base_policy = &optimistic;
 #endif
 
+    // paired evaluation of several policy types and/or widths: all
+    // policies are evaluated on the same sampled weathers
+    vector<string> policy_types, widths;
+    Utils::split(policy_type, ':', policy_types);
+    Utils::split(width_list, ':', widths);
+    if( (policy_types.size() > 1) || (widths.size() > 1) ) {
+        vector<const Online::Policy::policy_t<state_t>*> policies;
+        vector<string> names;
+        for( size_t i = 0; i < policy_types.size(); ++i ) {
+            for( size_t j = 0; j < widths.size(); ++j ) {
+                Online::Evaluation::parameters_t pars = eval_pars;
+                pars.width_ = strtoul(widths[j].c_str(), 0, 0);
+                pair<const Online::Policy::policy_t<state_t>*, string> policy =
+                  Online::Evaluation::select_policy(problem, base_name, policy_types[i], base_policies, heuristics, pars);
+                if( policy.first == 0 ) {
+                    cout << "error: " << policy.second << endl;
+                    exit(-1);
+                }
+                policies.push_back(policy.first);
+                names.push_back(policy.second);
+            }
+        }
+        problem_with_hidden_state_t pwhs(context, dead_end_value);
+        paired_trial_t trial(context, pwhs, policies, eval_pars.evaluation_depth_, shortcut_cost);
+        Online::Evaluation::paired_stats_t stats;
+        float start_time = Utils::read_time_in_seconds();
+        Online::Evaluation::paired_evaluation(policies.size(), eval_pars.evaluation_trials_, eval_pars.antithetic_, trial, stats, true);
+        float time = Utils::read_time_in_seconds() - start_time;
+        Online::Evaluation::print_paired_stats(cout, names, stats, eval_pars.antithetic_, time);
+        for( size_t i = 0; i < policies.size(); ++i ) {
+            policies[i]->print_stats(cout);
+            delete policies[i];
+        }
+        for( unsigned i = 0; i < results.size(); ++i ) {
+            delete results[i].hash_;
+        }
+        delete heuristic;
+        exit(0);
+    }
+
     // evaluate
     pair<const Online::Policy::policy_t<state_t>*, string> policy =
       Online::Evaluation::select_policy(problem, base_name, policy_type, base_policies, heuristics, eval_pars);
     if( policy.first != 0 ) {
-        problem_with_hidden_state_t pwhs(graph, dead_end_value);
+        problem_with_hidden_state_t pwhs(context, dead_end_value);
         vector<int> distances;
         vector<float> values;
         values.reserve(eval_pars.evaluation_trials_);
         float start_time = Utils::read_time_in_seconds();
         float sum = 0;
+        double mean = 0, m2 = 0; // Welford's statistics for sequential stopping
         cout << "#trials=" << eval_pars.evaluation_trials_ << ":";
         for( unsigned trial = 0; trial < eval_pars.evaluation_trials_; ++trial ) {
             cout << " " << trial << flush;
             // sample a good weather
-            state_t hidden(0);
-            sample_weather(graph, hidden);
-            //hidden.preprocess();
-            while( hidden.is_dead_end() ) {
-                sample_weather(graph, hidden);
-                //hidden.preprocess();
-            }
-            if( graph.with_shortcut_ ) hidden.set_edge_status(graph.num_edges_ - 1, false);
+            state_t hidden(context, 0);
+            sample_good_weather(graph, hidden);
             pwhs.set_hidden(hidden);
             //cout << "hidden=" << hidden << endl;
 
             // do evaluation from start node
-            size_t steps = 0;
-            float cost = 0;
-            state_t state = pwhs.init();
-            while( (steps < eval_pars.evaluation_depth_) && !pwhs.terminal(state) ) {
-                assert(!state.is_dead_end());
-                //cout << "state=" << state << " " << (state.is_dead_end() ? 1 : 0) << endl;
-                //cout << "dist=" << state.distances_ << endl;
-                Problem::action_t action = (*policy.first)(state);
-                //cout << "act=" << action << endl;
-                assert(action != Problem::noop);
-                assert(problem.applicable(state, action));
-                pair<state_t, bool> p = pwhs.sample(state, action);
-#if 1
-                if( pwhs.cost(state, action) == shortcut_cost ) {
-                    cout << "large cost" << endl;
-                }
-#endif
-                cost += pwhs.cost(state, action);
-                state = p.first;
-                ++steps;
-            }
+            float cost = evaluation_trial(pwhs, *policy.first, eval_pars.evaluation_depth_, shortcut_cost);
             values.push_back(cost);
             sum += cost;
             cout << "(" << setprecision(1) << sum/(1+trial) << ")" << flush;
+
+            // stop when confidence half-width reaches the requested precision
+            double delta = cost - mean;
+            mean += delta / (1 + trial);
+            m2 += delta * (cost - mean);
+            if( (eval_pars.evaluation_precision_ > 0) &&
+                (1 + trial >= Utils::max(2u, eval_pars.evaluation_min_trials_)) &&
+                (1.96 * sqrt(m2 / trial / (1 + trial)) <= eval_pars.evaluation_precision_) ) {
+                break;
+            }
         }
         cout << endl;
         cout << "max-branching=" << problem.max_branching_ << endl;
         cout << "avg-branching=" << problem.avg_branching_ << endl;
-        state_t::print_stats(cout);
+        context.print_stats(cout);
         problem.print_stats(cout);
+        if( min_min_cache != 0 ) min_min_cache->print_stats(cout);
 
         // compute avg
+        unsigned trials = values.size();
         float avg = 0;
-        for( unsigned i = 0; i < eval_pars.evaluation_trials_; ++i ) {
+        for( unsigned i = 0; i < trials; ++i ) {
             avg += values[i];
         }
-        avg /= eval_pars.evaluation_trials_;
+        avg /= trials;
 
         // compute stdev
         float stdev = 0;
-        for( unsigned i = 0; i < eval_pars.evaluation_trials_; ++i ) {
+        for( unsigned i = 0; i < trials; ++i ) {
             stdev += (avg - values[i]) * (avg - values[i]);
         }
-        stdev = sqrt(stdev) / (eval_pars.evaluation_trials_ - 1);
+        stdev = sqrt(stdev) / (trials - 1);
 
         cout << policy.second
              << "= " << setprecision(5) << avg
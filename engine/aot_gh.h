@@ -473,7 +473,8 @@ template<typename T> class aot_t : public improvement_t<T> {
 
     // lookup a node in hash table; if not found, create a new entry.
     std::pair<state_node_t<T>*, bool> fetch_node(const T &state,
-                                                 unsigned depth) const {
+                                                 unsigned depth,
+                                                 std::vector<state_node_t<T>*> *pending = 0) const {
         typename hash_t<T>::iterator it =
           table_.find(std::make_pair(&state, depth));
         if( it == table_.end() ) {
@@ -491,7 +492,12 @@ template<typename T> class aot_t : public improvement_t<T> {
                 node->is_dead_end_ = true;
             } else {
                 node->gvalue_ = 0;
-                node->hvalue_ = evaluate(state, depth);
+                if( (pending != 0) && (heuristic_ != 0) && (depth < horizon_) ) {
+                    // heuristic value is computed later in batch
+                    pending->push_back(node);
+                } else {
+                    node->hvalue_ = evaluate(state, depth);
+                }
                 node->nsamples_ = leaf_nsamples_;
             }
             return std::make_pair(node, false);
@@ -529,18 +535,23 @@ template<typename T> class aot_t : public improvement_t<T> {
         std::vector<std::pair<T, float> > outcomes;
         problem().next(a_node->parent_->state_, a_node->action_, outcomes);
         a_node->children_.reserve(outcomes.size());
+        std::vector<state_node_t<T>*> pending;
         for( int i = 0, isz = outcomes.size(); i < isz; ++i ) {
             const T &state = outcomes[i].first;
             float prob = outcomes[i].second;
-            std::pair<state_node_t<T>*, bool> p = fetch_node(state, 1 + a_node->parent_->depth_);
+            std::pair<state_node_t<T>*, bool> p = fetch_node(state, 1 + a_node->parent_->depth_, &pending);
             if( p.second ) {
                 assert(p.first->is_leaf());
                 nodes_to_propagate.push_back(p.first);
             }
             p.first->parents_.push_back(std::make_pair(i, a_node));
             a_node->children_.push_back(std::make_pair(prob, p.first));
-            a_node->gvalue_ += prob * p.first->gvalue_;
-            a_node->hvalue_ += prob * p.first->hvalue_;
+        }
+        evaluate(pending);
+        for( int i = 0, isz = a_node->children_.size(); i < isz; ++i ) {
+            float prob = a_node->children_[i].first;
+            a_node->gvalue_ += prob * a_node->children_[i].second->gvalue_;
+            a_node->hvalue_ += prob * a_node->children_[i].second->hvalue_;
         }
         a_node->gvalue_ = a_node->action_cost_ + problem().discount() * a_node->gvalue_;
         a_node->hvalue_ *= problem().discount();
@@ -649,6 +660,18 @@ template<typename T> class aot_t : public improvement_t<T> {
             return Evaluation::evaluation(base_policy_, s, leaf_nsamples_, horizon_ - depth);
         }
     }
+    // evaluate new leaves with heuristic in a single batch
+    void evaluate(const std::vector<state_node_t<T>*> &nodes) const {
+        if( nodes.empty() ) return;
+        std::vector<const T*> states(nodes.size());
+        std::vector<float> values(nodes.size());
+        for( size_t i = 0, isz = nodes.size(); i < isz; ++i )
+            states[i] = &nodes[i]->state_;
+        total_evaluations_ += nodes.size() * leaf_nsamples_;
+        heuristic_->values(&states[0], nodes.size(), &values[0]);
+        for( size_t i = 0, isz = nodes.size(); i < isz; ++i )
+            nodes[i]->hvalue_ = values[i];
+    }
     float evaluate(const T &state, Problem::action_t action, unsigned depth) const {
         // CHECK: this need to be revised when using heuristics
         float value = 0;
@@ -0,0 +1,246 @@
+/*
+ *  Copyright (C) 2011 Universidad Simon Bolivar
+ * 
+ *  Permission is hereby granted to distribute this software for
+ *  non-commercial research purposes, provided that this copyright
+ *  notice is included with any such distribution.
+ *  
+ *  THIS SOFTWARE IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ *  EITHER EXPRESSED OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE.  THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE
+ *  SOFTWARE IS WITH YOU.  SHOULD THE PROGRAM PROVE DEFECTIVE, YOU
+ *  ASSUME THE COST OF ALL NECESSARY SERVICING, REPAIR OR CORRECTION.
+ *  
+ *  Blai Bonet, bonet@ldc.usb.ve
+ *
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "problem.h"
+#include "random.h"
+#include "utils.h"
+
+#include <iostream>
+#include <iomanip>
+#include <cassert>
+#include <limits>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <time.h>
+
+//#define DEBUG
+
+// Microbenchmarks for engine primitives. Each benchmark is a functor
+// that performs a fixed number of operations per call. The functor is
+// called once to warm up and calibrate, and then 'repetitions' times,
+// each timed separately, so that the mean, stdev and min cost per
+// operation can be reported. Small workloads are called several times
+// per repetition so that each timing covers at least min_time seconds.
+
+namespace Benchmark {
+
+const double min_time = 2e-3;
+
+inline double wall_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+struct stats_t {
+    unsigned repetitions_;
+    size_t operations_;
+    double mean_;  // nsecs per operation
+    double stdev_; // nsecs per operation
+    double min_;   // nsecs per operation
+    double max_;   // nsecs per operation
+
+    stats_t()
+      : repetitions_(0), operations_(0),
+        mean_(0), stdev_(0), min_(0), max_(0) { }
+
+    void print(std::ostream &os, const std::string &name) const {
+        os << std::fixed << std::setprecision(2)
+           << std::setw(46) << std::left << name << std::right
+           << " ops=" << std::setw(9) << operations_
+           << " reps=" << std::setw(3) << repetitions_
+           << " ns/op: mean=" << std::setw(10) << mean_
+           << " stdev=" << std::setw(9) << stdev_
+           << " min=" << std::setw(10) << min_
+           << " max=" << std::setw(10) << max_
+           << std::endl;
+    }
+};
+
+// sink used to prevent the compiler from optimizing away results
+struct sink_t {
+    volatile float value_;
+    sink_t() : value_(0) { }
+    void consume(float value) { value_ = value_ + value; }
+};
+
+template<typename F>
+inline stats_t measure(F &f, size_t operations, unsigned repetitions) {
+    assert(repetitions > 0);
+    assert(operations > 0);
+    stats_t stats;
+    stats.repetitions_ = repetitions;
+    stats.operations_ = operations;
+
+    // warm up and calibrate number of calls per repetition
+    double start_time = wall_time();
+    f();
+    double warm_up = wall_time() - start_time;
+    unsigned calls = warm_up >= min_time ? 1 : 1 + (unsigned)(min_time / Utils::max(warm_up, 1e-9));
+
+    // Welford's running mean and variance
+    double mean = 0, m2 = 0;
+    stats.min_ = std::numeric_limits<double>::max();
+    stats.max_ = 0;
+    for( unsigned rep = 0; rep < repetitions; ++rep ) {
+        double start_time = wall_time();
+        for( unsigned call = 0; call < calls; ++call ) f();
+        double elapsed = 1e9 * (wall_time() - start_time) / (calls * operations);
+        double delta = elapsed - mean;
+        mean += delta / (1 + rep);
+        m2 += delta * (elapsed - mean);
+        stats.min_ = elapsed < stats.min_ ? elapsed : stats.min_;
+        stats.max_ = elapsed > stats.max_ ? elapsed : stats.max_;
+    }
+    stats.mean_ = mean;
+    stats.stdev_ = repetitions > 1 ? sqrt(m2 / (repetitions - 1)) : 0;
+    return stats;
+}
+
+template<typename F>
+inline stats_t run(std::ostream &os,
+                   const std::string &name,
+                   F &f,
+                   size_t operations,
+                   unsigned repetitions) {
+    stats_t stats = measure(f, operations, repetitions);
+    stats.print(os, name);
+    return stats;
+}
+
+// Collect (state,action) pairs by performing random walks from the
+// initial state. Only pairs with applicable actions are collected. Stops
+// early, with fewer pairs, if a walk adds none (e.g. the initial state is
+// terminal, a dead end or has no applicable actions).
+template<typename T>
+inline void collect_pairs(const Problem::problem_t<T> &problem,
+                          size_t npairs,
+                          unsigned max_walk_length,
+                          std::vector<std::pair<T, Problem::action_t> > &pairs) {
+    pairs.clear();
+    pairs.reserve(npairs);
+    std::vector<Problem::action_t> actions;
+    while( pairs.size() < npairs ) {
+        size_t collected = pairs.size();
+        T s = problem.init();
+        for( unsigned step = 0; (step < max_walk_length) && (pairs.size() < npairs); ++step ) {
+            if( problem.terminal(s) || problem.dead_end(s) ) break;
+            actions.clear();
+            for( Problem::action_t a = 0; a < problem.number_actions(s); ++a ) {
+                if( problem.applicable(s, a) ) actions.push_back(a);
+            }
+            if( actions.empty() ) break;
+            Problem::action_t a = actions[Random::uniform(actions.size())];
+            pairs.push_back(std::make_pair(s, a));
+            s = problem.sample(s, a).first;
+        }
+        if( pairs.size() == collected ) break;
+    }
+}
+
+template<typename T> struct next_functor_t {
+    const Problem::problem_t<T> &problem_;
+    const std::vector<std::pair<T, Problem::action_t> > &pairs_;
+    std::vector<std::pair<T, float> > outcomes_;
+    sink_t sink_;
+    next_functor_t(const Problem::problem_t<T> &problem,
+                   const std::vector<std::pair<T, Problem::action_t> > &pairs)
+      : problem_(problem), pairs_(pairs) { }
+    void operator()() {
+        for( size_t i = 0, isz = pairs_.size(); i < isz; ++i ) {
+            problem_.next(pairs_[i].first, pairs_[i].second, outcomes_);
+            sink_.consume(outcomes_.size());
+        }
+    }
+};
+
+template<typename T> struct sample_functor_t {
+    const Problem::problem_t<T> &problem_;
+    const std::vector<std::pair<T, Problem::action_t> > &pairs_;
+    sink_t sink_;
+    sample_functor_t(const Problem::problem_t<T> &problem,
+                     const std::vector<std::pair<T, Problem::action_t> > &pairs)
+      : problem_(problem), pairs_(pairs) { }
+    void operator()() {
+        for( size_t i = 0, isz = pairs_.size(); i < isz; ++i ) {
+            std::pair<T, bool> p = problem_.sample(pairs_[i].first, pairs_[i].second);
+            sink_.consume(p.second ? 1 : 0);
+        }
+    }
+};
+
+template<typename T> struct best_qvalue_functor_t {
+    const Problem::hash_t<T> &hash_;
+    const std::vector<std::pair<T, Problem::action_t> > &pairs_;
+    sink_t sink_;
+    best_qvalue_functor_t(const Problem::hash_t<T> &hash,
+                          const std::vector<std::pair<T, Problem::action_t> > &pairs)
+      : hash_(hash), pairs_(pairs) { }
+    void operator()() {
+        for( size_t i = 0, isz = pairs_.size(); i < isz; ++i ) {
+            std::pair<Problem::action_t, float> p = hash_.bestQValue(pairs_[i].first);
+            sink_.consume(p.second);
+        }
+    }
+};
+
+// Runs next(), sample() and hash_t::bestQValue() over (state,action)
+// pairs collected with random walks. The hash table used for bestQValue
+// contains all states in the walks, so lookups of successors mostly hit.
+template<typename T>
+inline void problem_suite(std::ostream &os,
+                          const std::string &prefix,
+                          const Problem::problem_t<T> &problem,
+                          size_t npairs,
+                          unsigned repetitions,
+                          unsigned max_walk_length = 1000) {
+    std::vector<std::pair<T, Problem::action_t> > pairs;
+    collect_pairs(problem, npairs, max_walk_length, pairs);
+    if( pairs.empty() ) {
+        os << "error: no (state,action) pairs reachable from the initial state" << std::endl;
+        return;
+    }
+
+    Problem::hash_t<T> hash(problem);
+    for( size_t i = 0, isz = pairs.size(); i < isz; ++i )
+        hash.update(pairs[i].first, 0);
+
+    next_functor_t<T> next(problem, pairs);
+    run(os, prefix + "::next()", next, pairs.size(), repetitions);
+
+    sample_functor_t<T> sample(problem, pairs);
+    run(os, prefix + "::sample()", sample, pairs.size(), repetitions);
+
+    problem.set_sample_cache(pairs.size());
+    run(os, prefix + "::sample() [cached]", sample, pairs.size(), repetitions);
+    problem.set_sample_cache(0);
+
+    best_qvalue_functor_t<T> best_qvalue(hash, pairs);
+    run(os, prefix + "::hash_t::bestQValue()", best_qvalue, pairs.size(), repetitions);
+}
+
+}; // namespace Benchmark
+
+#undef DEBUG
+
+#endif
+
@@ -244,12 +244,21 @@ inline std::pair<const Policy::policy_t<T>*, std::string>
         ss << base_name;
         policy = base_policy->clone();
     } else if( policy_type == "rollout" ) {
+        ss << policy_type << "(" << base_name
+           << ",width=" << par.width_
+           << ",depth=" << par.depth_
+           << ",nesting=" << par.par1_;
+        if( par.threads_ > 1 ) ss << ",threads=" << par.threads_;
+        ss << ")";
+        policy = Policy::make_nested_rollout(*base_policy, par.width_, par.depth_, par.par1_, par.threads_);
+    } else if( policy_type == "rollout/adaptive" ) {
         ss << policy_type << "(" << base_name
            << ",width=" << par.width_
            << ",depth=" << par.depth_
            << ",nesting=" << par.par1_
+           << ",round=" << par.par2_
            << ")";
-        policy = Policy::make_nested_rollout(*base_policy, par.width_, par.depth_, par.par1_);
+        policy = Policy::make_nested_adaptive_rollout(*base_policy, par.width_, par.depth_, par.par1_, par.par2_);
     } else if( (policy_type.length() >= 3) && !policy_type.compare(0, 3, "uct") ) {
         // UCT family
         ss << policy_type << "(" << base_name
@@ -359,16 +368,70 @@ inline std::pair<std::pair<float, float>, float>
                   const parameters_t &par,
                   bool verbose = false) {
     float start_time = Utils::read_time_in_seconds();
-    std::pair<float, float> value =
-      Evaluation::evaluation_with_stdev(policy,
-                                        policy.problem().init(),
-                                        par.evaluation_trials_,
-                                        par.evaluation_depth_,
-                                        verbose);
+    std::pair<float, float> value;
+    if( par.evaluation_precision_ > 0 ) {
+        value = Evaluation::sequential_evaluation(policy,
+                                                  policy.problem().init(),
+                                                  par.evaluation_precision_,
+                                                  par.evaluation_min_trials_,
+                                                  par.evaluation_trials_,
+                                                  par.evaluation_depth_,
+                                                  1.96,
+                                                  verbose);
+    } else {
+        value = Evaluation::evaluation_with_stdev(policy,
+                                                  policy.problem().init(),
+                                                  par.evaluation_trials_,
+                                                  par.evaluation_depth_,
+                                                  verbose);
+    }
     float time = Utils::read_time_in_seconds() - start_time;
     return std::make_pair(value, time);
 }
 
+// Paired evaluation of policies on common random numbers; returns time
+template<typename T>
+inline float evaluate_policies(const std::vector<const Policy::policy_t<T>*> &policies,
+                               const parameters_t &par,
+                               paired_stats_t &stats,
+                               bool verbose = false) {
+    assert(!policies.empty());
+    float start_time = Utils::read_time_in_seconds();
+    paired_trial_t<T> trial(policies, policies[0]->problem().init(), par.evaluation_depth_);
+    Evaluation::paired_evaluation(policies.size(),
+                                  par.evaluation_trials_,
+                                  par.antithetic_,
+                                  trial,
+                                  stats,
+                                  verbose);
+    return Utils::read_time_in_seconds() - start_time;
+}
+
+inline void print_paired_stats(std::ostream &os,
+                               const std::vector<std::string> &names,
+                               const paired_stats_t &stats,
+                               bool antithetic,
+                               float time) {
+    os << "paired: #policies=" << names.size()
+       << ", #trials=" << stats.trials_
+       << ", antithetic=" << (antithetic ? 1 : 0)
+       << ", time=" << std::setprecision(2) << time
+       << std::endl;
+    for( size_t i = 0; i < names.size(); ++i ) {
+        os << names[i]
+           << "= " << std::setprecision(5) << stats.mean_[i]
+           << " " << stats.error_[i]
+           << std::endl;
+    }
+    for( size_t i = 1; i < names.size(); ++i ) {
+        os << "diff: " << names[i] << " - " << names[0]
+           << "= " << std::setprecision(5) << stats.diff_mean_[i]
+           << " " << stats.diff_error_[i]
+           << " (95% half-width=" << 1.96 * stats.diff_error_[i] << ")"
+           << std::endl;
+    }
+}
+
 }; // namespace Evaluation
 
 }; // namespace Online
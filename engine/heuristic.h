@@ -22,11 +22,17 @@
 #include "hash.h"
 #include "problem.h"
 #include "parameters.h"
+#include "table.h"
 #include "utils.h"
 
 #include <iostream>
 #include <cassert>
+#include <functional>
 #include <limits>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <vector>
 #include <limits.h>
 
 //#define DEBUG
@@ -50,6 +56,13 @@ template<typename T> class heuristic_t {
     void set_name(const std::string &name) { name_ = name; }
     const std::string& name() const { return name_; }
     virtual float value(const T &s) const = 0;
+    // batch evaluation: out[i] = value(*states[i]) for i < n. States are
+    // passed by pointer so that callers need not copy them into an array.
+    // Table-driven heuristics override it to amortize lookups.
+    virtual void values(const T *const *states, size_t n, float *out) const {
+        for( size_t i = 0; i < n; ++i )
+            out[i] = value(*states[i]);
+    }
     virtual void reset_stats() const = 0;
     virtual float setup_time() const = 0;
     virtual float eval_time() const = 0;
@@ -63,6 +76,9 @@ template<typename T> class zero_heuristic_t : public heuristic_t<T> {
     zero_heuristic_t() : heuristic_t<T>("zero()") { }
     virtual ~zero_heuristic_t() { }
     virtual float value(const T &s) const { return 0; }
+    virtual void values(const T *const *states, size_t n, float *out) const {
+        for( size_t i = 0; i < n; ++i ) out[i] = 0;
+    }
     virtual void reset_stats() const { }
     virtual float setup_time() const { return 0; }
     virtual float eval_time() const { return 0; }
@@ -70,32 +86,363 @@ template<typename T> class zero_heuristic_t : public heuristic_t<T> {
     virtual void dump(std::ostream &os) const { }
 };
 
+// The min-min heuristic is computed with value iteration over the whole
+// state space. If a cache file is given, values are mapped from it when
+// it exists and matches the key; otherwise, they are computed and saved
+// into the file for later runs.
 template<typename T> class min_min_heuristic_t : public heuristic_t<T> {
   protected:
     float divisor_;
     const Problem::problem_t<T> &problem_;
     mutable Problem::min_hash_t<T> hash_;
+    Table::table_t<T> table_;
     mutable float time_;
 
   public:
-    min_min_heuristic_t(const Problem::problem_t<T> &problem, float divisor = 1.0)
+    min_min_heuristic_t(const Problem::problem_t<T> &problem,
+                        float divisor = 1.0,
+                        const std::string &cache_file = "",
+                        const std::string &key = "")
       : heuristic_t<T>("min-min()"), divisor_(divisor), problem_(problem), hash_(problem), time_(0) {
 
-      Algorithm::parameters_t parameters;
-      parameters.vi.max_number_iterations_ = std::numeric_limits<unsigned>::max();
-
       float start_time = Utils::read_time_in_seconds();
-      Algorithm::value_iteration<T>(problem_, problem_.init(), hash_, parameters);
+      if( cache_file.empty() || !table_.map(cache_file, key) ) {
+          Algorithm::parameters_t parameters;
+          parameters.vi.max_number_iterations_ = std::numeric_limits<unsigned>::max();
+          Algorithm::value_iteration<T>(problem_, problem_.init(), hash_, parameters);
+          if( !cache_file.empty() ) hash_.save(cache_file, key);
+      }
       float end_time = Utils::read_time_in_seconds();
       time_ = end_time - start_time;
     } 
     virtual ~min_min_heuristic_t() { }
-    virtual float value(const T &s) const { return hash_.value(s) / divisor_; }
+    virtual float value(const T &s) const {
+        if( table_.empty() ) {
+            return hash_.value(s) / divisor_;
+        } else {
+            const Table::record_t<T> *record = table_.lookup(s);
+            return record == 0 ? 0 : record->value_ / divisor_;
+        }
+    }
+    virtual void values(const T *const *states, size_t n, float *out) const {
+        if( table_.empty() ) {
+            for( size_t i = 0; i < n; ++i )
+                out[i] = hash_.value(*states[i]) / divisor_;
+        } else {
+            std::vector<const Table::record_t<T>*> records(n);
+            if( n > 0 ) table_.lookup(states, n, &records[0]);
+            for( size_t i = 0; i < n; ++i )
+                out[i] = records[i] == 0 ? 0 : records[i]->value_ / divisor_;
+        }
+    }
     virtual void reset_stats() const { }
     virtual float setup_time() const { return time_; }
     virtual float eval_time() const { return 0; }
-    virtual size_t size() const { return hash_.size(); }
-    virtual void dump(std::ostream &os) const { hash_.dump(os); }
+    virtual size_t size() const { return table_.empty() ? hash_.size() : table_.size(); }
+    virtual void dump(std::ostream &os) const {
+        if( table_.empty() ) {
+            hash_.dump(os);
+        } else {
+            for( size_t i = 0; i < table_.size(); ++i ) {
+                const Table::record_t<T> &record = table_.record(i);
+                os << record.state_ << " : " << record.value_ << std::endl;
+            }
+        }
+    }
+};
+
+// Lazy min-min heuristic: values are computed on demand with a search on
+// the all-outcomes determinization, from the queried state until a terminal
+// state, or a state whose value is already known, is reached. There is no
+// predecessor function, so each query runs forward. Work is reused across
+// queries as in Adaptive A*: after a search of cost h*(s), h*(s) - g(x) is
+// a lower bound for every expanded state x and guides later searches. Exact
+// values are memoized for states on optimal paths (found by following the
+// predecessors that achieve g), and for dead ends found by exhausting the
+// search. Values coincide with those of min_min_heuristic_t, but setup is
+// free and memory grows with the part of the space actually searched.
+template<typename T> class lazy_min_min_heuristic_t : public heuristic_t<T> {
+  protected:
+    float divisor_;
+    const Problem::problem_t<T> &problem_;
+    mutable Hash::generic_hash_map_t<T, float> values_;  // exact values
+    mutable Hash::generic_hash_map_t<T, float> bounds_;  // lower bounds
+    mutable float time_;
+    mutable unsigned searches_;
+    mutable size_t expansions_;
+    mutable std::mutex mutex_;                           // queries may come from parallel rollouts
+
+    typedef std::pair<float, unsigned> node_t;
+    typedef std::priority_queue<node_t, std::vector<node_t>, std::greater<node_t> > queue_t;
+
+    float bound(const T &s) const {
+        typename Hash::generic_hash_map_t<T, float>::const_iterator bi = bounds_.find(s);
+        return bi == bounds_.end() ? 0 : bi->second;
+    }
+
+    float search(const T &s) const {
+        std::vector<T> states;
+        std::vector<float> g, h;
+        std::vector<bool> expanded;
+        std::vector<std::vector<std::pair<unsigned, float> > > parents;
+        Hash::generic_hash_map_t<T, unsigned> index;
+        std::vector<std::pair<T, float> > outcomes;
+        queue_t open;
+
+        ++searches_;
+        states.push_back(s);
+        g.push_back(0);
+        h.push_back(bound(s));
+        expanded.push_back(false);
+        parents.push_back(std::vector<std::pair<unsigned, float> >());
+        index.insert(std::make_pair(s, 0));
+        open.push(std::make_pair(h[0], 0));
+
+        float best = std::numeric_limits<float>::max();
+        int best_node = -1;
+        while( !open.empty() ) {
+            node_t n = open.top();
+            open.pop();
+            unsigned i = n.second;
+            if( n.first > g[i] + h[i] ) continue;
+            if( n.first >= best ) break;
+
+            T state = states[i];
+            typename Hash::generic_hash_map_t<T, float>::const_iterator vi = values_.find(state);
+            if( vi != values_.end() ) {
+                if( (vi->second != std::numeric_limits<float>::max()) && (g[i] + vi->second < best) ) {
+                    best = g[i] + vi->second;
+                    best_node = i;
+                }
+                continue;
+            }
+            if( problem_.terminal(state) ) {
+                best = g[i];
+                best_node = i;
+                continue;
+            }
+
+            ++expansions_;
+            expanded[i] = true;
+            for( Problem::action_t a = 0; a < problem_.number_actions(state); ++a ) {
+                if( problem_.applicable(state, a) ) {
+                    float c = problem_.cost(state, a);
+                    float cost = g[i] + c;
+                    problem_.next(state, a, outcomes);
+                    for( size_t k = 0, ksz = outcomes.size(); k < ksz; ++k ) {
+                        std::pair<typename Hash::generic_hash_map_t<T, unsigned>::iterator, bool> p =
+                          index.insert(std::make_pair(outcomes[k].first, states.size()));
+                        unsigned j = p.first->second;
+                        if( p.second ) {
+                            states.push_back(outcomes[k].first);
+                            g.push_back(cost);
+                            h.push_back(bound(outcomes[k].first));
+                            expanded.push_back(false);
+                            parents.push_back(std::vector<std::pair<unsigned, float> >(1, std::make_pair(i, c)));
+                            open.push(std::make_pair(cost + h[j], j));
+                        } else if( cost < g[j] ) {
+                            g[j] = cost;
+                            parents[j].assign(1, std::make_pair(i, c));
+                            open.push(std::make_pair(cost + h[j], j));
+                        } else if( cost == g[j] ) {
+                            parents[j].push_back(std::make_pair(i, c));
+                        }
+                    }
+                }
+            }
+        }
+
+        if( best_node == -1 ) {
+            // search exhausted: no generated state reaches a terminal state
+            for( size_t i = 0, isz = states.size(); i < isz; ++i )
+                values_[states[i]] = std::numeric_limits<float>::max();
+        } else {
+            // update lower bounds of expanded states
+            for( size_t i = 0, isz = states.size(); i < isz; ++i ) {
+                if( expanded[i] && (best - g[i] > h[i]) )
+                    bounds_[states[i]] = best - g[i];
+            }
+
+            // states on optimal paths are those reached backwards from the
+            // best node through predecessors that achieve the g-values
+            std::vector<bool> marked(states.size(), false);
+            std::vector<unsigned> stack(1, best_node);
+            marked[best_node] = true;
+            while( !stack.empty() ) {
+                unsigned i = stack.back();
+                stack.pop_back();
+                values_[states[i]] = best - g[i];
+                bounds_.erase(states[i]);
+                for( size_t k = 0, ksz = parents[i].size(); k < ksz; ++k ) {
+                    unsigned j = parents[i][k].first;
+                    if( !marked[j] && (g[j] + parents[i][k].second == g[i]) ) {
+                        marked[j] = true;
+                        stack.push_back(j);
+                    }
+                }
+            }
+        }
+        return values_[s];
+    }
+
+  public:
+    lazy_min_min_heuristic_t(const Problem::problem_t<T> &problem, float divisor = 1.0)
+      : heuristic_t<T>("lazy-min-min()"), divisor_(divisor), problem_(problem),
+        time_(0), searches_(0), expansions_(0) {
+    }
+    virtual ~lazy_min_min_heuristic_t() { }
+    virtual float value(const T &s) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        typename Hash::generic_hash_map_t<T, float>::const_iterator vi = values_.find(s);
+        float v = 0;
+        if( vi != values_.end() ) {
+            v = vi->second;
+        } else {
+            float start_time = Utils::read_time_in_seconds();
+            v = search(s);
+            time_ += Utils::read_time_in_seconds() - start_time;
+        }
+        return v == std::numeric_limits<float>::max() ? v : v / divisor_;
+    }
+    virtual void reset_stats() const {
+        time_ = 0;
+        searches_ = 0;
+        expansions_ = 0;
+    }
+    virtual float setup_time() const { return 0; }
+    virtual float eval_time() const { return time_; }
+    virtual size_t size() const { return values_.size() + bounds_.size(); }
+    unsigned searches() const { return searches_; }
+    size_t expansions() const { return expansions_; }
+    virtual void dump(std::ostream &os) const {
+        for( typename Hash::generic_hash_map_t<T, float>::const_iterator vi = values_.begin(); vi != values_.end(); ++vi )
+            os << vi->first << " : " << vi->second << std::endl;
+    }
+};
+
+// Memoizing wrapper for expensive heuristics with bounded memory. At most
+// capacity values are stored; when the cache is full, an entry is evicted
+// with the CLOCK algorithm (second chance for entries referenced since the
+// hand last passed them). eval_time() is the time spent in misses, and
+// size() is the number of cached values.
+template<typename T> class cached_heuristic_t : public heuristic_t<T> {
+  protected:
+    struct entry_t {
+        const T *state_;    // key stored in index_
+        float value_;
+        bool referenced_;
+        entry_t(const T *state, float value)
+          : state_(state), value_(value), referenced_(false) { }
+    };
+
+    const heuristic_t<T> &heuristic_;
+    size_t capacity_;
+    mutable std::vector<entry_t> entries_;
+    mutable Hash::generic_hash_map_t<T, unsigned> index_;
+    mutable size_t hand_;
+    mutable size_t lookups_;
+    mutable size_t hits_;
+    mutable size_t evictions_;
+    mutable float time_;
+
+  public:
+    cached_heuristic_t(const heuristic_t<T> &heuristic, size_t capacity)
+      : heuristic_t<T>(std::string("cached(") + heuristic.name() + ")"),
+        heuristic_(heuristic), capacity_(capacity), hand_(0),
+        lookups_(0), hits_(0), evictions_(0), time_(0) {
+        entries_.reserve(capacity_);
+    }
+    virtual ~cached_heuristic_t() { }
+
+    void insert(const T &s, float value) const {
+        if( capacity_ == 0 ) return;
+        if( entries_.size() < capacity_ ) {
+            std::pair<typename Hash::generic_hash_map_t<T, unsigned>::iterator, bool> p =
+              index_.insert(std::make_pair(s, entries_.size()));
+            if( p.second ) entries_.push_back(entry_t(&p.first->first, value));
+        } else {
+            if( index_.find(s) != index_.end() ) return;
+            while( entries_[hand_].referenced_ ) {
+                entries_[hand_].referenced_ = false;
+                hand_ = (1 + hand_) % capacity_;
+            }
+            index_.erase(*entries_[hand_].state_);
+            typename Hash::generic_hash_map_t<T, unsigned>::iterator it =
+              index_.insert(std::make_pair(s, hand_)).first;
+            entries_[hand_] = entry_t(&it->first, value);
+            hand_ = (1 + hand_) % capacity_;
+            ++evictions_;
+        }
+    }
+
+    virtual float value(const T &s) const {
+        ++lookups_;
+        typename Hash::generic_hash_map_t<T, unsigned>::const_iterator it = index_.find(s);
+        if( it != index_.end() ) {
+            ++hits_;
+            entries_[it->second].referenced_ = true;
+            return entries_[it->second].value_;
+        }
+
+        float start_time = Utils::read_time_in_seconds();
+        float value = heuristic_.value(s);
+        time_ += Utils::read_time_in_seconds() - start_time;
+        insert(s, value);
+        return value;
+    }
+    virtual void values(const T *const *states, size_t n, float *out) const {
+        std::vector<const T*> misses;
+        std::vector<size_t> positions;
+        lookups_ += n;
+        for( size_t i = 0; i < n; ++i ) {
+            typename Hash::generic_hash_map_t<T, unsigned>::const_iterator it = index_.find(*states[i]);
+            if( it != index_.end() ) {
+                ++hits_;
+                entries_[it->second].referenced_ = true;
+                out[i] = entries_[it->second].value_;
+            } else {
+                misses.push_back(states[i]);
+                positions.push_back(i);
+            }
+        }
+        if( !misses.empty() ) {
+            std::vector<float> values(misses.size());
+            float start_time = Utils::read_time_in_seconds();
+            heuristic_.values(&misses[0], misses.size(), &values[0]);
+            time_ += Utils::read_time_in_seconds() - start_time;
+            for( size_t i = 0, isz = misses.size(); i < isz; ++i ) {
+                out[positions[i]] = values[i];
+                insert(*misses[i], values[i]);
+            }
+        }
+    }
+    virtual void reset_stats() const {
+        lookups_ = 0;
+        hits_ = 0;
+        evictions_ = 0;
+        time_ = 0;
+        heuristic_.reset_stats();
+    }
+    virtual float setup_time() const { return heuristic_.setup_time(); }
+    virtual float eval_time() const { return time_; }
+    virtual size_t size() const { return entries_.size(); }
+    virtual void dump(std::ostream &os) const {
+        for( size_t i = 0, isz = entries_.size(); i < isz; ++i )
+            os << *entries_[i].state_ << " : " << entries_[i].value_ << std::endl;
+    }
+
+    size_t lookups() const { return lookups_; }
+    size_t hits() const { return hits_; }
+    void print_stats(std::ostream &os) const {
+        os << "heuristic-cache: capacity=" << capacity_
+           << ", #entries=" << entries_.size()
+           << ", #lookups=" << lookups_
+           << ", #hits=" << hits_
+           << ", %hit=" << (lookups_ == 0 ? 0 : (float)hits_ / (float)lookups_)
+           << ", #evictions=" << evictions_
+           << ", eval-time=" << time_
+           << std::endl;
+    }
 };
 
 template<typename T> class hash_heuristic_t : public heuristic_t<T> {
@@ -114,6 +461,36 @@ template<typename T> class hash_heuristic_t : public heuristic_t<T> {
     virtual void dump(std::ostream &os) const { hash_.dump(os); }
 };
 
+template<typename T> class table_heuristic_t : public heuristic_t<T> {
+  protected:
+    const Table::table_t<T> &table_;
+
+  public:
+    table_heuristic_t(const Table::table_t<T> &table)
+      : heuristic_t<T>("table()"), table_(table) { }
+    virtual ~table_heuristic_t() { }
+    virtual float value(const T &s) const {
+        const Table::record_t<T> *record = table_.lookup(s);
+        return record == 0 ? 0 : record->value_;
+    }
+    virtual void values(const T *const *states, size_t n, float *out) const {
+        std::vector<const Table::record_t<T>*> records(n);
+        if( n > 0 ) table_.lookup(states, n, &records[0]);
+        for( size_t i = 0; i < n; ++i )
+            out[i] = records[i] == 0 ? 0 : records[i]->value_;
+    }
+    virtual void reset_stats() const { }
+    virtual float setup_time() const { return 0; }
+    virtual float eval_time() const { return 0; }
+    virtual size_t size() const { return table_.size(); }
+    virtual void dump(std::ostream &os) const {
+        for( size_t i = 0; i < table_.size(); ++i ) {
+            const Table::record_t<T> &record = table_.record(i);
+            os << record.state_ << " : " << record.value_ << std::endl;
+        }
+    }
+};
+
 template<typename T> class weighted_heuristic_t : public heuristic_t<T> {
   protected:
     const heuristic_t<T> &heuristic_;
@@ -124,6 +501,10 @@ template<typename T> class weighted_heuristic_t : public heuristic_t<T> {
       : heuristic_(heuristic), weight_(weight) { }
     virtual ~weighted_heuristic_t() { }
     virtual float value(const T &s) const { return weight_ * heuristic_.value(s); }
+    virtual void values(const T *const *states, size_t n, float *out) const {
+        heuristic_.values(states, n, out);
+        for( size_t i = 0; i < n; ++i ) out[i] *= weight_;
+    }
     virtual void reset_stats() const { heuristic_.reset_stats(); }
     virtual float setup_time() const { return heuristic_.setup_time(); }
     virtual float eval_time() const { return heuristic_.eval_time(); }
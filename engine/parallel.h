@@ -0,0 +1,130 @@
+/*
+ *  Copyright (C) 2011 Universidad Simon Bolivar
+ *
+ *  Permission is hereby granted to distribute this software for
+ *  non-commercial research purposes, provided that this copyright
+ *  notice is included with any such distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ *  EITHER EXPRESSED OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE.  THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE
+ *  SOFTWARE IS WITH YOU.  SHOULD THE PROGRAM PROVE DEFECTIVE, YOU
+ *  ASSUME THE COST OF ALL NECESSARY SERVICING, REPAIR OR CORRECTION.
+ *
+ *  Blai Bonet, bonet@ldc.usb.ve
+ *
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <iostream>
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//#define DEBUG
+
+// Fixed pool of worker threads for parallel loops. A loop is a job that
+// is called once for each item in [0,n); items are handed out one at a
+// time to workers. The calling thread participates as worker 0, so a
+// pool of size k uses k-1 extra threads and run() returns when all items
+// are done. Jobs receive the worker number so that they can use
+// per-worker data (e.g. policy clones) without locking.
+
+namespace Parallel {
+
+struct job_t {
+    virtual ~job_t() { }
+    virtual void operator()(unsigned item, unsigned worker) = 0;
+};
+
+class pool_t {
+  protected:
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    job_t *job_;
+    unsigned num_items_;
+    unsigned next_item_;
+    unsigned active_;
+    unsigned generation_;
+    bool stop_;
+
+    // fetch next item of current job; returns false when there are no more
+    bool fetch(unsigned &item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if( next_item_ >= num_items_ ) return false;
+        item = next_item_++;
+        return true;
+    }
+
+    void work(unsigned worker) {
+        unsigned item;
+        while( fetch(item) ) (*job_)(item, worker);
+    }
+
+    void loop(unsigned worker) {
+        unsigned generation = 0;
+        while( true ) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                while( !stop_ && (generation_ == generation) ) work_cv_.wait(lock);
+                if( stop_ ) return;
+                generation = generation_;
+                ++active_;
+            }
+            work(worker);
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if( --active_ == 0 ) done_cv_.notify_all();
+            }
+        }
+    }
+
+  public:
+    pool_t(unsigned size)
+      : job_(0), num_items_(0), next_item_(0),
+        active_(0), generation_(0), stop_(false) {
+        assert(size > 0);
+        for( unsigned worker = 1; worker < size; ++worker )
+            threads_.push_back(std::thread(&pool_t::loop, this, worker));
+    }
+    ~pool_t() {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+        for( size_t i = 0; i < threads_.size(); ++i )
+            threads_[i].join();
+    }
+
+    unsigned size() const { return 1 + threads_.size(); }
+
+    void run(unsigned num_items, job_t &job) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            job_ = &job;
+            num_items_ = num_items;
+            next_item_ = 0;
+            ++generation_;
+        }
+        work_cv_.notify_all();
+        work(0);
+        std::unique_lock<std::mutex> lock(mutex_);
+        while( active_ > 0 ) done_cv_.wait(lock);
+        job_ = 0;
+    }
+};
+
+}; // namespace Parallel
+
+#undef DEBUG
+
+#endif
+
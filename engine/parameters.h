@@ -71,16 +71,21 @@ namespace Evaluation {
 struct parameters_t {
     unsigned evaluation_trials_;
     unsigned evaluation_depth_;
+    float evaluation_precision_;     // if > 0, stop when CI half-width <= precision
+    unsigned evaluation_min_trials_;
+    bool antithetic_;                // antithetic trials in paired evaluation
     unsigned width_;
     unsigned depth_;
     float par1_;
     unsigned par2_;
     unsigned labeling_;
     float weight_;
+    unsigned threads_;
     parameters_t()
       : evaluation_trials_(1000), evaluation_depth_(100),
+        evaluation_precision_(0), evaluation_min_trials_(30), antithetic_(false),
         width_(0), depth_(0), par1_(0), par2_(0), labeling_(false),
-        weight_(1.0) {
+        weight_(1.0), threads_(1) {
     }
 };
 
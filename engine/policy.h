@@ -133,6 +133,62 @@ template<typename T> class hash_policy_t : public policy_t<T> {
     }
 };
 
+// Table-based policy: select action stored in a (possibly mapped) table.
+// States not in table are resolved with 1-step lookahead over the values
+// stored in the table.
+template<typename T> class table_policy_t : public policy_t<T> {
+  using policy_t<T>::problem;
+
+  protected:
+    const Table::table_t<T> &table_;
+    mutable unsigned misses_;
+
+  public:
+    table_policy_t(const Problem::problem_t<T> &problem, const Table::table_t<T> &table)
+      : policy_t<T>("table()", problem), table_(table), misses_(0) {
+    }
+    virtual ~table_policy_t() { }
+    virtual const policy_t<T>* clone() const { return new table_policy_t(problem(), table_); }
+
+    float value(const T &s) const {
+        const Table::record_t<T> *record = table_.lookup(s);
+        return record == 0 ? 0 : record->value_;
+    }
+
+    virtual Problem::action_t operator()(const T &s) const {
+        ++policy_t<T>::decisions_;
+        const Table::record_t<T> *record = table_.lookup(s);
+        if( (record != 0) && (record->action_ != Problem::noop) ) {
+            assert(problem().applicable(s, record->action_));
+            return record->action_;
+        }
+
+        ++misses_;
+        std::vector<std::pair<T, float> > outcomes;
+        Problem::action_t best_action = Problem::noop;
+        float best_value = std::numeric_limits<float>::max();
+        for( Problem::action_t a = 0; a < problem().number_actions(s); ++a ) {
+            if( problem().applicable(s, a) ) {
+                problem().next(s, a, outcomes);
+                float qv = 0;
+                for( size_t i = 0, isz = outcomes.size(); i < isz; ++i )
+                    qv += outcomes[i].second * value(outcomes[i].first);
+                qv = problem().cost(s, a) + problem().discount() * qv;
+                if( qv < best_value ) {
+                    best_value = qv;
+                    best_action = a;
+                }
+            }
+        }
+        return best_action;
+    }
+    virtual void print_stats(std::ostream &os) const {
+        os << "stats: policy=" << policy_t<T>::name() << std::endl;
+        os << "stats: decisions=" << policy_t<T>::decisions_ << std::endl;
+        os << "stats: misses=" << misses_ << std::endl;
+    }
+};
+
 // Base class for greedy policies wrt 1-step-lookahead of heuristic
 template<typename T> class base_greedy_t : public policy_t<T> {
   using policy_t<T>::problem;
@@ -172,6 +228,8 @@ template<typename T> class base_greedy_t : public policy_t<T> {
     virtual Problem::action_t operator()(const T &s) const {
         ++policy_t<T>::decisions_;
         std::vector<std::pair<T, float> > outcomes;
+        std::vector<const T*> states;
+        std::vector<float> hvalues;
         std::vector<Problem::action_t> best_actions;
         int nactions = problem().number_actions(s);
         float best_value = std::numeric_limits<float>::max();
@@ -180,8 +238,16 @@ template<typename T> class base_greedy_t : public policy_t<T> {
             if( problem().applicable(s, a) ) {
                 float value = optimistic_ ? std::numeric_limits<float>::max() : 0;
                 problem().next(s, a, outcomes);
+
+                // evaluate heuristic on all outcomes in one batch
+                states.resize(outcomes.size());
+                hvalues.resize(outcomes.size());
+                for( size_t i = 0, isz = outcomes.size(); i < isz; ++i )
+                    states[i] = &outcomes[i].first;
+                if( !outcomes.empty() ) heuristic_.values(&states[0], outcomes.size(), &hvalues[0]);
+
                 for( size_t i = 0, isz = outcomes.size(); i < isz; ++i ) {
-                    float hval = heuristic_.value(outcomes[i].first);
+                    float hval = hvalues[i];
                     if( optimistic_ ) {
                         value = hval < value ? hval : value;
                     } else {
@@ -324,6 +390,177 @@ inline std::pair<float, float>
     return std::make_pair(avg, stdev);
 }
 
+// Sequential evaluation: trials are run until the half-width of the
+// confidence interval for the mean (z standard errors) is at most
+// half_width, with at least min_trials and at most max_trials trials.
+// Mean and variance are maintained with Welford's method, so no values
+// are stored. The second component is computed as in evaluation_with_stdev.
+template<typename T>
+inline std::pair<float, float>
+  sequential_evaluation(const Policy::policy_t<T> &policy,
+                        const T &s,
+                        float half_width,
+                        unsigned min_trials,
+                        unsigned max_trials,
+                        unsigned max_depth,
+                        float z = 1.96,
+                        bool verbose = false) {
+    double mean = 0, m2 = 0;
+    unsigned trials = 0;
+    if( verbose ) std::cout << "#trials<=" << max_trials << ":";
+    while( trials < max_trials ) {
+        if( verbose ) std::cout << " " << trials << std::flush;
+        double value = evaluation_trial(policy, s, max_depth);
+        double delta = value - mean;
+        mean += delta / ++trials;
+        m2 += delta * (value - mean);
+        if( verbose ) {
+            std::cout << "(" << std::setprecision(1) << mean << ")"
+                      << std::flush;
+        }
+        if( (trials >= Utils::max(2u, min_trials)) &&
+            (z * sqrt(m2 / (trials - 1) / trials) <= half_width) ) {
+            break;
+        }
+    }
+    if( verbose ) {
+        std::cout << std::endl
+                  << "#trials=" << trials
+                  << ", half-width=" << std::setprecision(5)
+                  << (trials > 1 ? z * sqrt(m2 / (trials - 1) / trials) : 0)
+                  << std::endl;
+    }
+    return std::make_pair(mean, trials > 1 ? sqrt(m2) / (trials - 1) : 0);
+}
+
+// Trial with separate random streams for the environment (transitions
+// of the evaluated trajectory) and for the policy (its internal sampling).
+// The streams are switched around each call so that the environment sees
+// the same random numbers regardless of how many the policy consumes.
+// Antithetic mode, if set, only applies to the environment stream.
+template<typename T>
+inline float paired_evaluation_trial(const Policy::policy_t<T> &policy,
+                                     const T &s,
+                                     unsigned max_depth,
+                                     Random::state_t &environment,
+                                     Random::state_t &policy_stream,
+                                     bool antithetic) {
+    const Problem::problem_t<T> &problem = policy.problem();
+    T state = s;
+    size_t steps = 0;
+    float cost = 0;
+    float discount = 1;
+    if( problem.dead_end(state) ) return problem.dead_end_value();
+    while( (steps < max_depth) && !problem.terminal(state) ) {
+        Random::set_state(policy_stream);
+        Problem::action_t action = policy(state);
+        policy_stream = Random::get_state();
+        if( action == Problem::noop ) return cost + problem.dead_end_value();
+        assert(problem.applicable(state, action));
+        Random::set_state(environment);
+        Random::set_antithetic(antithetic);
+        std::pair<T, bool> p = problem.sample(state, action);
+        Random::set_antithetic(false);
+        environment = Random::get_state();
+        cost += discount * problem.cost(state, action);
+        discount *= problem.discount();
+        state = p.first;
+        ++steps;
+        if( problem.dead_end(state) ) return cost + problem.dead_end_value();
+    }
+    return cost;
+}
+
+// Statistics of paired evaluation: mean and standard error of each policy,
+// and of the difference of each policy with the first one.
+struct paired_stats_t {
+    unsigned trials_;
+    std::vector<float> mean_;
+    std::vector<float> error_;
+    std::vector<float> diff_mean_;
+    std::vector<float> diff_error_;
+};
+
+// Paired evaluation of number_policies policies with common random numbers.
+// trial(i, environment, policy_stream, antithetic) runs one trial of i-th
+// policy; in trial t, all policies get the same environment and policy
+// streams, both determined by t and a seed drawn from the caller's stream.
+// In antithetic mode, trials come in pairs that share streams, the second
+// one with antithetic environment draws; each pair counts as one sample
+// (its average). The caller's random stream is restored on exit.
+template<typename F>
+inline void paired_evaluation(size_t number_policies,
+                              unsigned number_trials,
+                              bool antithetic,
+                              F &trial,
+                              paired_stats_t &stats,
+                              bool verbose = false) {
+    size_t n = number_policies;
+    std::vector<double> mean(n, 0), m2(n, 0), dmean(n, 0), dm2(n, 0);
+    std::vector<float> values(n);
+    unsigned samples = antithetic ? (number_trials + 1) / 2 : number_trials;
+
+    unsigned seed = Random::uniform(std::numeric_limits<int>::max());
+    Random::state_t state = Random::get_state();
+    if( verbose ) std::cout << "#samples=" << samples << ":";
+    for( unsigned k = 0; k < samples; ++k ) {
+        if( verbose ) std::cout << " " << k << std::flush;
+        for( size_t i = 0; i < n; ++i ) {
+            values[i] = 0;
+            for( unsigned m = 0; m < (antithetic ? 2u : 1u); ++m ) {
+                Random::set_stream(seed, 2*k);
+                Random::state_t environment = Random::get_state();
+                Random::set_stream(seed, 2*k + 1);
+                Random::state_t policy_stream = Random::get_state();
+                values[i] += trial(i, environment, policy_stream, m == 1);
+            }
+            if( antithetic ) values[i] /= 2;
+        }
+
+        // Welford's updates for values and differences
+        for( size_t i = 0; i < n; ++i ) {
+            double delta = values[i] - mean[i];
+            mean[i] += delta / (1 + k);
+            m2[i] += delta * (values[i] - mean[i]);
+            double d = values[i] - values[0];
+            delta = d - dmean[i];
+            dmean[i] += delta / (1 + k);
+            dm2[i] += delta * (d - dmean[i]);
+        }
+    }
+    if( verbose ) std::cout << std::endl;
+    Random::set_state(state);
+
+    stats.trials_ = antithetic ? 2 * samples : samples;
+    stats.mean_.resize(n);
+    stats.error_.resize(n);
+    stats.diff_mean_.resize(n);
+    stats.diff_error_.resize(n);
+    for( size_t i = 0; i < n; ++i ) {
+        stats.mean_[i] = mean[i];
+        stats.error_[i] = samples > 1 ? sqrt(m2[i] / (samples - 1) / samples) : 0;
+        stats.diff_mean_[i] = dmean[i];
+        stats.diff_error_[i] = samples > 1 ? sqrt(dm2[i] / (samples - 1) / samples) : 0;
+    }
+}
+
+// trials of paired evaluation for policies starting at given state
+template<typename T> struct paired_trial_t {
+    const std::vector<const Policy::policy_t<T>*> &policies_;
+    const T &s_;
+    unsigned max_depth_;
+    paired_trial_t(const std::vector<const Policy::policy_t<T>*> &policies,
+                   const T &s,
+                   unsigned max_depth)
+      : policies_(policies), s_(s), max_depth_(max_depth) { }
+    float operator()(size_t i,
+                     Random::state_t &environment,
+                     Random::state_t &policy_stream,
+                     bool antithetic) const {
+        return paired_evaluation_trial(*policies_[i], s_, max_depth_, environment, policy_stream, antithetic);
+    }
+};
+
 }; // namespace Evaluation
 
 }; // namespace Online
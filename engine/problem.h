@@ -21,11 +21,14 @@
 
 #include "hash.h"
 #include "random.h"
+#include "table.h"
 #include "utils.h"
 
 #include <iostream>
+#include <iomanip>
 #include <cassert>
 #include <limits>
+#include <string>
 #include <vector>
 #include <float.h>
 
@@ -83,6 +86,51 @@ template<typename T> class hash_t : public Hash::hash_map_t<T> {
         }
         return std::make_pair(best_action, best_value);
     }
+
+    // save values, solved flags and best actions into a binary table
+    // that can be later mapped with Table::table_t<T>::map()
+    bool save(const std::string &filename, const std::string &key) const {
+        std::vector<Table::record_t<T> > records;
+        records.reserve(this->size());
+        for( typename base_type::const_iterator hi = this->begin(); hi != this->end(); ++hi ) {
+            const T &s = (*hi).first;
+            action_t a = problem_.terminal(s) ? noop : bestQValue(s).first;
+            records.push_back(Table::record_t<T>(s, (*hi).second->value(), a, (*hi).second->solved()));
+        }
+        Table::table_t<T> table;
+        table.build(records, key);
+        return table.write(filename);
+    }
+
+    // compile greedy policy into table: one record with best action for
+    // each state reachable from s under the greedy policy, so that each
+    // decision becomes a single table lookup
+    size_t compile(const T &s, Table::table_t<T> &table, const std::string &key) const {
+        std::vector<Table::record_t<T> > records;
+        Hash::generic_hash_map_t<T, bool> visited;
+        std::vector<T> open;
+        std::vector<std::pair<T, float> > outcomes;
+        visited.insert(std::make_pair(s, true));
+        open.push_back(s);
+        while( !open.empty() ) {
+            T state = open.back();
+            open.pop_back();
+            action_t a = noop;
+            if( !problem_.terminal(state) && !problem_.dead_end(state) ) {
+                a = bestQValue(state).first;
+                if( a != noop ) {
+                    problem_.next(state, a, outcomes);
+                    for( size_t i = 0, isz = outcomes.size(); i < isz; ++i ) {
+                        if( visited.insert(std::make_pair(outcomes[i].first, true)).second )
+                            open.push_back(outcomes[i].first);
+                    }
+                }
+            }
+            records.push_back(Table::record_t<T>(state, this->value(state), a, this->solved(state)));
+        }
+        table.build(records, key);
+        return records.size();
+    }
 };
 
 template<typename T> class min_hash_t : public hash_t<T> {
@@ -98,6 +146,153 @@ template<typename T> class min_hash_t : public hash_t<T> {
 };
 
 
+// Cache of samplers for problem_t::sample(). For each (state,action) pair,
+// the outcomes given by next() are stored with an alias table (Vose's
+// method) so that later samples take O(1) time and do not call next().
+// At most capacity pairs are stored; when full, a pair is evicted with
+// the CLOCK algorithm and its vectors are reused. The cache is not
+// thread safe.
+template<typename T> class sample_cache_t {
+  public:
+    typedef std::pair<T, action_t> key_t;
+    struct key_hash_t {
+        size_t operator()(const key_t &key) const {
+            return key.first.hash() * 31 + key.second;
+        }
+    };
+
+  protected:
+    struct entry_t {
+        const key_t *key_;           // key stored in index_
+        std::vector<T> states_;
+        std::vector<float> probs_;
+        std::vector<unsigned> alias_;
+        bool referenced_;
+        entry_t() : key_(0), referenced_(false) { }
+    };
+
+    size_t capacity_;
+    std::vector<entry_t> entries_;
+    Hash::generic_hash_map_t<key_t, unsigned, key_hash_t> index_;
+    size_t hand_;
+    size_t lookups_;
+    size_t hits_;
+    size_t evictions_;
+    std::vector<std::pair<T, float> > outcomes_;
+    std::vector<unsigned> small_;
+    std::vector<unsigned> large_;
+
+    void build(entry_t &entry) {
+        unsigned n = outcomes_.size();
+        float mass = 0;
+        for( unsigned i = 0; i < n; ++i ) mass += outcomes_[i].second;
+        entry.states_.resize(n);
+        entry.probs_.resize(n);
+        entry.alias_.resize(n);
+        small_.clear();
+        large_.clear();
+        for( unsigned i = 0; i < n; ++i ) {
+            entry.states_[i] = outcomes_[i].first;
+            entry.probs_[i] = outcomes_[i].second * n / mass;
+            entry.alias_[i] = i;
+            if( entry.probs_[i] < 1 )
+                small_.push_back(i);
+            else
+                large_.push_back(i);
+        }
+        while( !small_.empty() && !large_.empty() ) {
+            unsigned l = small_.back(), g = large_.back();
+            small_.pop_back();
+            entry.alias_[l] = g;
+            entry.probs_[g] -= 1 - entry.probs_[l];
+            if( entry.probs_[g] < 1 ) {
+                large_.pop_back();
+                small_.push_back(g);
+            }
+        }
+        // remaining columns are full (up to rounding errors)
+        for( size_t i = 0; i < small_.size(); ++i ) entry.probs_[small_[i]] = 1;
+        for( size_t i = 0; i < large_.size(); ++i ) entry.probs_[large_[i]] = 1;
+    }
+
+    unsigned insert(const key_t &key) {
+        unsigned slot = 0;
+        if( entries_.size() < capacity_ ) {
+            slot = entries_.size();
+            entries_.push_back(entry_t());
+        } else {
+            while( entries_[hand_].referenced_ ) {
+                entries_[hand_].referenced_ = false;
+                hand_ = (1 + hand_) % capacity_;
+            }
+            slot = hand_;
+            index_.erase(*entries_[slot].key_);
+            hand_ = (1 + hand_) % capacity_;
+            ++evictions_;
+        }
+        entries_[slot].key_ = &index_.insert(std::make_pair(key, slot)).first->first;
+        entries_[slot].referenced_ = false;
+        return slot;
+    }
+
+  public:
+    sample_cache_t(size_t capacity)
+      : capacity_(capacity), hand_(0), lookups_(0), hits_(0), evictions_(0) {
+        assert(capacity_ > 0);
+        entries_.reserve(capacity_);
+    }
+    ~sample_cache_t() { }
+
+    size_t capacity() const { return capacity_; }
+    size_t size() const { return entries_.size(); }
+    size_t lookups() const { return lookups_; }
+    size_t hits() const { return hits_; }
+
+    T sample(const problem_t<T> &problem, const T &s, action_t a) {
+        ++lookups_;
+        key_t key(s, a);
+        typename Hash::generic_hash_map_t<key_t, unsigned, key_hash_t>::const_iterator it = index_.find(key);
+        unsigned slot = 0;
+        if( it != index_.end() ) {
+            ++hits_;
+            slot = it->second;
+            entries_[slot].referenced_ = true;
+        } else {
+            problem.next(s, a, outcomes_);
+            assert(!outcomes_.empty());
+            slot = insert(key);
+            build(entries_[slot]);
+        }
+
+        const entry_t &entry = entries_[slot];
+        unsigned n = entry.states_.size();
+        float u = Random::real() * n;
+        unsigned i = Utils::min((unsigned)u, n - 1);
+        return u - i < entry.probs_[i] ? entry.states_[i] : entry.states_[entry.alias_[i]];
+    }
+
+    void print_stats(std::ostream &os) const {
+        os << "sample-cache: capacity=" << capacity_
+           << ", #entries=" << entries_.size()
+           << ", #lookups=" << lookups_
+           << ", #hits=" << hits_
+           << ", %hit=" << std::setprecision(1)
+           << (lookups_ == 0 ? 0 : 100.0 * (float)hits_ / (float)lookups_)
+           << ", #evictions=" << evictions_
+           << std::endl;
+    }
+};
+
+// Counter that receives the expansions of the calling thread instead of
+// the problem, or 0 if they go to the problem. Pool workers other than
+// the caller point it to a private tally, which is added to the problem
+// by the caller once the job is done, so that the shared counter is only
+// written by one thread.
+inline size_t*& _expansion_tally() {
+    static __thread size_t *tally = 0;
+    return tally;
+}
+
 // A instance of problem_t represents an MDP problem. It contains all the 
 // necessary information to run the different algorithms.
 
@@ -107,11 +302,20 @@ template<typename T> class problem_t {
     float discount_;
     float dead_end_value_;
     mutable size_t expansions_;
+    mutable sample_cache_t<T> *sample_cache_;
 
   public:
     problem_t(float discount = 1.0, float dead_end_value = 1e3)
-      : discount_(discount), dead_end_value_(dead_end_value), expansions_(0) { }
-    virtual ~problem_t() { }
+      : discount_(discount), dead_end_value_(dead_end_value), expansions_(0),
+        sample_cache_(0) { }
+    virtual ~problem_t() { delete sample_cache_; }
+
+    // enable cache of samplers with given capacity (0 disables it)
+    void set_sample_cache(size_t capacity) const {
+        delete sample_cache_;
+        sample_cache_ = capacity == 0 ? 0 : new sample_cache_t<T>(capacity);
+    }
+    const sample_cache_t<T>* sample_cache() const { return sample_cache_; }
 
     float discount() const { return discount_; }
     float dead_end_value() const { return dead_end_value_; }
@@ -119,6 +323,16 @@ template<typename T> class problem_t {
     size_t expansions() const {
         return expansions_;
     }
+    void add_expansions(size_t n) const {
+        size_t *tally = _expansion_tally();
+        if( tally == 0 )
+            expansions_ += n;
+        else
+            *tally += n;
+    }
+    void inc_expansions() const {
+        add_expansions(1);
+    }
     void clear_expansions() const {
         expansions_ = 0;
     }
@@ -131,8 +345,12 @@ template<typename T> class problem_t {
     virtual float cost(const T &s, action_t a) const = 0;
     virtual void next(const T &s, action_t a, std::vector<std::pair<T, float> > &outcomes) const = 0;
 
-    // sample next state given action using problem's dynamics
-    std::pair<T, bool> sample(const T &s, action_t a) const {
+    // sample next state given action using problem's dynamics. The default
+    // implementation enumerates the outcomes with next(); domains with a
+    // generative model should override it to sample directly (and defer
+    // to this implementation when the cache of samplers is enabled).
+    virtual std::pair<T, bool> sample(const T &s, action_t a) const {
+        if( sample_cache_ != 0 ) return std::make_pair(sample_cache_->sample(*this, s, a), true);
         std::vector<std::pair<T, float> > outcomes;
         next(s, a, outcomes);
         unsigned osize = outcomes.size();
@@ -205,6 +423,7 @@ template<typename T> class problem_t {
         if( !terminal(s) && !hash.marked(s) ) {
             hash.mark(s);
             std::pair<action_t, float> p = hash.bestQValue(s);
+            if( p.first == noop ) return 1; // no applicable action (dead end)
             next(s, p.first, outcomes);
             unsigned osize = outcomes.size();
             for( unsigned i = 0; i < osize; ++i ) {
@@ -27,15 +27,75 @@
 
 namespace Random {
 
+// The generator is the one of drand48/lrand48 (same sequences for the same
+// seed), but its state is per thread so that workers of a parallel loop can
+// use independent streams. Threads other than the main one must select
+// their stream with set_seed() or set_stream() before using the generator.
+
+struct state_t {
+    unsigned short xsubi_[3];
+};
+
+inline unsigned short* _state() {
+    // initial value is the default state of drand48
+    static __thread unsigned short xsubi[3] = { 0x330E, 0xABCD, 0x1234 };
+    return xsubi;
+}
+
 inline void set_seed(int seed) {
     unsigned short useed[3];
     useed[0] = useed[1] = useed[2] = seed;
     srand48((long int)seed);
     seed48(useed);
+    unsigned short *xsubi = _state();
+    xsubi[0] = xsubi[1] = xsubi[2] = seed;
+}
+
+inline state_t get_state() {
+    state_t state;
+    unsigned short *xsubi = _state();
+    for( int i = 0; i < 3; ++i ) state.xsubi_[i] = xsubi[i];
+    return state;
+}
+
+inline void set_state(const state_t &state) {
+    unsigned short *xsubi = _state();
+    for( int i = 0; i < 3; ++i ) xsubi[i] = state.xsubi_[i];
+}
+
+// select stream number 'stream' for given seed. Streams are obtained by
+// scrambling (seed, stream) with a 64-bit mixer, so that results of
+// parallel loops only depend on the seed and the item number.
+inline void set_stream(unsigned seed, unsigned stream) {
+    unsigned long long z = ((unsigned long long)seed << 32) | stream;
+    z += 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    unsigned short *xsubi = _state();
+    xsubi[0] = z & 0xFFFF;
+    xsubi[1] = (z >> 16) & 0xFFFF;
+    xsubi[2] = (z >> 32) & 0xFFFF;
+}
+
+// In antithetic mode, real() returns 1-u and uniform(n) returns n-1-k
+// instead of u and k, so that a trial run twice on the same stream, the
+// second time in antithetic mode, yields negatively correlated outcomes.
+inline bool& _antithetic() {
+    static __thread bool antithetic = false;
+    return antithetic;
+}
+
+inline void set_antithetic(bool antithetic) {
+    _antithetic() = antithetic;
+}
+
+inline bool antithetic() {
+    return _antithetic();
 }
 
 inline float _random_float() {
-    float d = drand48();
+    float d = erand48(_state());
 #ifdef DEBUG
     std::cerr << "_random_float: " << d << std::endl;
 #endif
@@ -43,7 +103,7 @@ inline float _random_float() {
 }
 
 inline unsigned _random_unsigned() {
-    int r = lrand48();
+    int r = nrand48(_state());
 #ifdef DEBUG
     std::cerr << "_random_unsigned: " << r << std::endl;
 #endif
@@ -51,12 +111,15 @@ inline unsigned _random_unsigned() {
 }
 
 inline float real() {
-    return _random_float();
+    float d = _random_float();
+    return _antithetic() ? 1 - d : d;
 }
 
 inline unsigned uniform(unsigned max) {
     assert(max > 0);
-    return max == 1 ? 0 : _random_unsigned() % max;
+    if( max == 1 ) return 0;
+    unsigned r = _random_unsigned() % max;
+    return _antithetic() ? max - 1 - r : r;
 }
 
 inline unsigned uniform(unsigned min, unsigned max) {
@@ -19,13 +19,16 @@
 #ifndef ROLLOUT_H
 #define ROLLOUT_H
 
+#include "parallel.h"
 #include "policy.h"
+#include "random.h"
 
 #include <iostream>
 #include <sstream>
 #include <cassert>
 #include <limits>
 #include <vector>
+#include <math.h>
 
 //#define DEBUG
 
@@ -35,7 +38,12 @@ namespace Policy {
 
 namespace Rollout {
 
-// nested rollout policy
+// nested rollout policy. If a pool of workers is given, the rollouts for
+// each decision are distributed among the workers; each (action, trial)
+// pair is an item that runs on a private clone of the base policy and on a
+// random stream determined by the item number and a seed drawn from the
+// caller's stream. Hence, the decisions do not depend on the number of
+// workers nor on the scheduling of items.
 template<typename T> class rollout_t : public improvement_t<T> {
   using policy_t<T>::problem;
 
@@ -43,30 +51,87 @@ template<typename T> class rollout_t : public improvement_t<T> {
     unsigned width_;
     unsigned depth_;
     unsigned nesting_;
+    const policy_t<T> *owned_base_policy_;
+    Parallel::pool_t *pool_;
+    std::vector<const policy_t<T>*> worker_policies_;
+
+    struct job_t : public Parallel::job_t {
+        const rollout_t &rollout_;
+        const T &s_;
+        const std::vector<Problem::action_t> &actions_;
+        unsigned seed_;
+        std::vector<float> &values_;
+        std::vector<size_t> &expansions_;
+        job_t(const rollout_t &rollout,
+              const T &s,
+              const std::vector<Problem::action_t> &actions,
+              unsigned seed,
+              std::vector<float> &values,
+              std::vector<size_t> &expansions)
+          : rollout_(rollout), s_(s), actions_(actions), seed_(seed),
+            values_(values), expansions_(expansions) { }
+        virtual void operator()(unsigned item, unsigned worker) {
+            // workers other than the caller count expansions privately
+            size_t expansions = 0;
+            size_t *&tally = Problem::_expansion_tally();
+            size_t *saved_tally = tally;
+            if( worker != 0 ) tally = &expansions;
+
+            Random::set_stream(seed_, item);
+            Problem::action_t a = actions_[item / rollout_.width_];
+            std::pair<T, bool> p = rollout_.problem().sample(s_, a);
+            values_[item] = rollout_.problem().cost(s_, a) +
+              rollout_.problem().discount() *
+              rollout_.evaluate(*rollout_.worker_policies_[worker], p.first);
+
+            tally = saved_tally;
+            expansions_[worker] += expansions;
+        }
+    };
 
   public:
     rollout_t(const policy_t<T> &base_policy,
               unsigned width,
               unsigned depth,
-              unsigned nesting)
+              unsigned nesting,
+              unsigned threads = 1)
       : improvement_t<T>(base_policy),
-        width_(width), depth_(depth), nesting_(nesting) {
+        width_(width), depth_(depth), nesting_(nesting),
+        owned_base_policy_(0), pool_(0) {
         std::stringstream name_stream;
         name_stream << "rollout("
                     << "width=" << width_
                     << ",depth=" << depth_
-                    << ",nesting=" << nesting_
-                    << ")";
+                    << ",nesting=" << nesting_;
+        if( threads > 1 ) name_stream << ",threads=" << threads;
+        name_stream << ")";
         policy_t<T>::set_name(name_stream.str());
+        if( threads > 1 ) {
+            pool_ = new Parallel::pool_t(threads);
+            for( unsigned worker = 0; worker < threads; ++worker )
+                worker_policies_.push_back(base_policy.clone());
+        }
+    }
+    virtual ~rollout_t() {
+        for( size_t i = 0; i < worker_policies_.size(); ++i )
+            delete worker_policies_[i];
+        delete pool_;
+        delete owned_base_policy_;
     }
-    virtual ~rollout_t() { }
 
+    // clones own a clone of the base policy so that clones of nested
+    // rollouts can be used concurrently
     virtual const policy_t<T>* clone() const {
-        return new rollout_t(improvement_t<T>::base_policy_, width_, depth_, nesting_);
+        const policy_t<T> *base_policy = improvement_t<T>::base_policy_.clone();
+        unsigned threads = pool_ == 0 ? 1 : pool_->size();
+        rollout_t *policy = new rollout_t(*base_policy, width_, depth_, nesting_, threads);
+        policy->owned_base_policy_ = base_policy;
+        return policy;
     }
 
     virtual Problem::action_t operator()(const T &s) const {
         ++policy_t<T>::decisions_;
+        if( pool_ != 0 ) return parallel_decision(s);
         Problem::action_t best_action = Problem::noop;
         float best_value = std::numeric_limits<float>::max();
         for( Problem::action_t a = 0; a < problem().number_actions(s); ++a ) {
@@ -89,9 +154,202 @@ template<typename T> class rollout_t : public improvement_t<T> {
     virtual void print_stats(std::ostream &os) const {
         os << "stats: policy=" << policy_t<T>::name() << std::endl;
         os << "stats: decisions=" << policy_t<T>::decisions_ << std::endl;
+        if( pool_ != 0 ) {
+            unsigned decisions = 0;
+            for( size_t i = 0; i < worker_policies_.size(); ++i )
+                decisions += worker_policies_[i]->decisions();
+            os << "stats: worker-decisions=" << decisions << std::endl;
+        }
         improvement_t<T>::base_policy_.print_stats(os);
     }
 
+    Problem::action_t parallel_decision(const T &s) const {
+        std::vector<Problem::action_t> actions;
+        for( Problem::action_t a = 0; a < problem().number_actions(s); ++a ) {
+            if( problem().applicable(s, a) ) actions.push_back(a);
+        }
+
+        // run rollouts in workers; caller's stream is saved because the
+        // caller participates as a worker
+        unsigned seed = Random::uniform(std::numeric_limits<int>::max());
+        Random::state_t state = Random::get_state();
+        std::vector<float> values(actions.size() * width_);
+        std::vector<size_t> expansions(pool_->size(), 0);
+        job_t job(*this, s, actions, seed, values, expansions);
+        pool_->run(values.size(), job);
+        Random::set_state(state);
+        size_t total = 0;
+        for( size_t i = 0; i < expansions.size(); ++i )
+            total += expansions[i];
+        problem().add_expansions(total);
+
+        // aggregate in the same order as the sequential version
+        Problem::action_t best_action = Problem::noop;
+        float best_value = std::numeric_limits<float>::max();
+        for( size_t i = 0; i < actions.size(); ++i ) {
+            float value = 0;
+            for( unsigned trial = 0; trial < width_; ++trial )
+                value += values[i * width_ + trial];
+            value /= width_;
+            if( value < best_value ) {
+                best_value = value;
+                best_action = actions[i];
+            }
+        }
+        assert(best_action != Problem::noop);
+        return best_action;
+    }
+
+    float evaluate(const T &s) const {
+        return evaluate(improvement_t<T>::base_policy_, s);
+    }
+    float evaluate(const policy_t<T> &base_policy, const T &s) const {
+        return Evaluation::evaluation(base_policy, s, 1, depth_);
+    }
+};
+
+// adaptive rollout policy: the budget of width samples per action is
+// allocated in rounds of increasing size (initial size given by round).
+// All actions are sampled with common random numbers (trial t of every
+// action runs on the same random stream), so actions are compared using
+// paired differences: after each round, an action is eliminated when the
+// confidence interval of its difference with the best action lies above
+// zero. Sampling stops when a single action survives or when the width
+// is exhausted. The number of samples saved with respect to rollout_t
+// is reported in the stats.
+template<typename T> class adaptive_rollout_t : public improvement_t<T> {
+  using policy_t<T>::problem;
+
+  protected:
+    unsigned width_;
+    unsigned depth_;
+    unsigned nesting_;
+    unsigned round_;
+    float z_;
+    mutable size_t samples_;
+    mutable size_t saved_;
+
+  public:
+    adaptive_rollout_t(const policy_t<T> &base_policy,
+                       unsigned width,
+                       unsigned depth,
+                       unsigned nesting,
+                       unsigned round = 0,
+                       float z = 2.0)
+      : improvement_t<T>(base_policy),
+        width_(width), depth_(depth), nesting_(nesting),
+        round_(round == 0 ? Utils::max(2u, width / 4) : round), z_(z),
+        samples_(0), saved_(0) {
+        std::stringstream name_stream;
+        name_stream << "rollout/adaptive("
+                    << "width=" << width_
+                    << ",depth=" << depth_
+                    << ",nesting=" << nesting_
+                    << ",round=" << round_
+                    << ")";
+        policy_t<T>::set_name(name_stream.str());
+    }
+    virtual ~adaptive_rollout_t() { }
+
+    virtual const policy_t<T>* clone() const {
+        return new adaptive_rollout_t(improvement_t<T>::base_policy_, width_, depth_, nesting_, round_, z_);
+    }
+
+    virtual Problem::action_t operator()(const T &s) const {
+        ++policy_t<T>::decisions_;
+        std::vector<Problem::action_t> actions;
+        for( Problem::action_t a = 0; a < problem().number_actions(s); ++a ) {
+            if( problem().applicable(s, a) ) actions.push_back(a);
+        }
+        assert(!actions.empty());
+        if( actions.size() == 1 ) {
+            saved_ += width_;
+            return actions[0];
+        }
+
+        // values[i][t] is the value of trial t of i-th action
+        std::vector<std::vector<float> > values(actions.size());
+        std::vector<unsigned> alive(actions.size());
+        for( unsigned i = 0; i < actions.size(); ++i ) {
+            values[i].reserve(width_);
+            alive[i] = i;
+        }
+
+        unsigned seed = Random::uniform(std::numeric_limits<int>::max());
+        Random::state_t state = Random::get_state();
+        unsigned trials = 0;
+        for( unsigned round = round_; (alive.size() > 1) && (trials < width_); round *= 2 ) {
+            unsigned last = Utils::min(width_, trials + round);
+            for( ; trials < last; ++trials ) {
+                for( unsigned j = 0; j < alive.size(); ++j ) {
+                    Problem::action_t a = actions[alive[j]];
+                    Random::set_stream(seed, trials);
+                    std::pair<T, bool> p = problem().sample(s, a);
+                    values[alive[j]].push_back(problem().cost(s, a) + problem().discount() * evaluate(p.first));
+                }
+                samples_ += alive.size();
+            }
+            eliminate(values, alive, trials);
+        }
+        Random::set_state(state);
+        saved_ += actions.size() * width_;
+        for( unsigned i = 0; i < actions.size(); ++i )
+            saved_ -= values[i].size();
+
+        unsigned best = alive[0];
+        for( unsigned j = 1; j < alive.size(); ++j ) {
+            if( mean(values[alive[j]], trials) < mean(values[best], trials) )
+                best = alive[j];
+        }
+        return actions[best];
+    }
+    virtual void print_stats(std::ostream &os) const {
+        os << "stats: policy=" << policy_t<T>::name() << std::endl;
+        os << "stats: decisions=" << policy_t<T>::decisions_ << std::endl;
+        os << "stats: samples=" << samples_
+           << ", saved=" << saved_
+           << ", saved/decision=" << (policy_t<T>::decisions_ == 0 ? 0 : (float)saved_ / (float)policy_t<T>::decisions_)
+           << std::endl;
+        improvement_t<T>::base_policy_.print_stats(os);
+    }
+
+    static float mean(const std::vector<float> &values, unsigned n) {
+        float sum = 0;
+        for( unsigned t = 0; t < n; ++t ) sum += values[t];
+        return sum / n;
+    }
+
+    // eliminate actions whose paired difference with the best action
+    // is positive with confidence given by z
+    void eliminate(const std::vector<std::vector<float> > &values,
+                   std::vector<unsigned> &alive,
+                   unsigned n) const {
+        if( n < 2 ) return;
+        unsigned best = alive[0];
+        for( unsigned j = 1; j < alive.size(); ++j ) {
+            if( mean(values[alive[j]], n) < mean(values[best], n) )
+                best = alive[j];
+        }
+        std::vector<unsigned> survivors;
+        for( unsigned j = 0; j < alive.size(); ++j ) {
+            unsigned i = alive[j];
+            if( i != best ) {
+                // Welford's mean and variance of differences
+                double dmean = 0, m2 = 0;
+                for( unsigned t = 0; t < n; ++t ) {
+                    double d = values[i][t] - values[best][t];
+                    double delta = d - dmean;
+                    dmean += delta / (1 + t);
+                    m2 += delta * (d - dmean);
+                }
+                double width = z_ * sqrt(m2 / (n - 1) / n);
+                if( dmean - width > 0 ) continue;
+            }
+            survivors.push_back(i);
+        }
+        alive.swap(survivors);
+    }
+
     float evaluate(const T &s) const {
         return Evaluation::evaluation(improvement_t<T>::base_policy_, s, 1, depth_);
     }
@@ -103,14 +361,34 @@ template<typename T>
 inline const policy_t<T>* make_nested_rollout(const policy_t<T> &base_policy,
                                               unsigned width,
                                               unsigned depth,
-                                              unsigned nesting = 1) {
+                                              unsigned nesting = 1,
+                                              unsigned threads = 1) {
+    std::vector<const policy_t<T>*> nested_policies;
+    nested_policies.reserve(1 + nesting);
+    nested_policies.push_back(&base_policy);
+    for( unsigned level = 0; level < nesting; ++level ) {
+        const policy_t<T> *policy = nested_policies.back();
+        policy_t<T> *rollout =
+          new Rollout::rollout_t<T>(*policy, width, depth, 1+level,
+                                    level + 1 == nesting ? threads : 1);
+        nested_policies.push_back(rollout);
+    }
+    return nested_policies.back();
+}
+
+template<typename T>
+inline const policy_t<T>* make_nested_adaptive_rollout(const policy_t<T> &base_policy,
+                                                       unsigned width,
+                                                       unsigned depth,
+                                                       unsigned nesting = 1,
+                                                       unsigned round = 0) {
     std::vector<const policy_t<T>*> nested_policies;
     nested_policies.reserve(1 + nesting);
     nested_policies.push_back(&base_policy);
     for( unsigned level = 0; level < nesting; ++level ) {
         const policy_t<T> *policy = nested_policies.back();
         policy_t<T> *rollout =
-          new Rollout::rollout_t<T>(*policy, width, depth, 1+level);
+          new Rollout::adaptive_rollout_t<T>(*policy, width, depth, 1+level, round);
         nested_policies.push_back(rollout);
     }
     return nested_policies.back();
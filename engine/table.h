@@ -0,0 +1,365 @@
+/*
+ *  Copyright (C) 2011 Universidad Simon Bolivar
+ * 
+ *  Permission is hereby granted to distribute this software for
+ *  non-commercial research purposes, provided that this copyright
+ *  notice is included with any such distribution.
+ *  
+ *  THIS SOFTWARE IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ *  EITHER EXPRESSED OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE.  THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE
+ *  SOFTWARE IS WITH YOU.  SHOULD THE PROGRAM PROVE DEFECTIVE, YOU
+ *  ASSUME THE COST OF ALL NECESSARY SERVICING, REPAIR OR CORRECTION.
+ *  
+ *  Blai Bonet, bonet@ldc.usb.ve
+ *
+ */
+
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//#define DEBUG
+
+namespace Problem {
+
+#ifndef __ACTION_TYPE
+#define __ACTION_TYPE
+    typedef int action_t;
+    const action_t noop = -1;
+#endif
+
+};
+
+// Compact binary tables of (state, value, action) records. A table is
+// built once in memory, written to disk, and later mapped read-only
+// with mmap. The file contains its own open-addressing index, so a
+// mapped table is usable without any construction and several
+// processes that map the same file share its pages.
+//
+// File layout:
+//
+//   header_t                       (header_size bytes)
+//   unsigned slots[capacity]       (index into records, or empty_slot)
+//   record_t<T> records[size]      (aligned to record_alignment)
+//
+// Records hold the key of each state rather than the state: key_t<T>
+// maps states to a plain-data type (the state itself by default) that is
+// stored as raw bytes, so it must be trivially copyable, comparable with
+// operator== and hashable with hash(). Domains whose states hold pointers
+// or caches specialize key_t. Domains whose states are plain fields but
+// keep hand-written copy members, which make small states cheaper to pass
+// around in the searches, specialize it as image_key_t. The table key
+// identifies what the table was built for; the header keeps a digest of
+// it and its first characters.
+
+namespace Table {
+
+template<typename T> struct key_t {
+    typedef T type;
+    static const T& make(const T &s) { return s; }
+};
+
+// byte image of a state made of plain fields
+template<typename T> struct image_t {
+    alignas(T) char bytes_[sizeof(T)];
+    explicit image_t(const T &s) { memcpy(bytes_, static_cast<const void*>(&s), sizeof(T)); }
+    const T& state() const { return *reinterpret_cast<const T*>(bytes_); }
+    size_t hash() const { return state().hash(); }
+    bool operator==(const image_t &image) const { return state() == image.state(); }
+};
+
+template<typename T> inline std::ostream& operator<<(std::ostream &os, const image_t<T> &image) {
+    return os << image.state();
+}
+
+template<typename T> struct image_key_t {
+    typedef image_t<T> type;
+    static image_t<T> make(const T &s) { return image_t<T>(s); }
+};
+
+const char magic[] = "MDPTBL2";
+const unsigned header_size = 256;
+const unsigned key_size = 192;
+const unsigned record_alignment = 16;
+const unsigned empty_slot = 0xFFFFFFFF;
+
+struct header_t {
+    char magic_[8];
+    char key_[key_size];   // prefix of the key, for messages
+    unsigned long long key_digest_;
+    unsigned state_size_;
+    unsigned record_size_;
+    unsigned size_;
+    unsigned capacity_;
+    unsigned long long slots_offset_;
+    unsigned long long records_offset_;
+};
+
+template<typename T> struct record_t {
+    typedef typename key_t<T>::type key_type;
+    static_assert(std::is_trivially_copyable<key_type>::value, "table keys must be plain data");
+
+    key_type state_;
+    float value_;
+    Problem::action_t action_;
+    bool solved_;
+    record_t(const T &state, float value, Problem::action_t action, bool solved)
+      : state_(key_t<T>::make(state)), value_(value), action_(action), solved_(solved) { }
+};
+
+inline size_t mix(size_t h) {
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h;
+}
+
+// FNV-1a digest of table keys
+inline unsigned long long digest(const std::string &key) {
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    for( size_t i = 0; i < key.size(); ++i ) {
+        h ^= (unsigned char)key[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+template<typename T> class table_t {
+  protected:
+    typedef typename key_t<T>::type key_type;
+
+    std::vector<char> buffer_;   // backing store for tables built in memory
+    const char *data_;
+    size_t length_;
+    bool mapped_;
+
+    const header_t& header() const {
+        return *reinterpret_cast<const header_t*>(data_);
+    }
+    const unsigned* slots() const {
+        return reinterpret_cast<const unsigned*>(data_ + header().slots_offset_);
+    }
+    const record_t<T>* records() const {
+        return reinterpret_cast<const record_t<T>*>(data_ + header().records_offset_);
+    }
+
+    // checks that the index and records of a mapped table lie within the
+    // file, that slots point to records, and that some slot is empty so
+    // that probes terminate
+    bool well_formed() const {
+        const header_t &h = header();
+        if( (h.capacity_ == 0) || ((h.capacity_ & (h.capacity_ - 1)) != 0) || (h.size_ >= h.capacity_) )
+            return false;
+        if( (h.slots_offset_ < header_size) || (h.slots_offset_ % sizeof(unsigned) != 0) ||
+            (h.slots_offset_ > length_) || ((size_t)h.capacity_ * sizeof(unsigned) > length_ - h.slots_offset_) )
+            return false;
+        if( (h.records_offset_ < h.slots_offset_ + (size_t)h.capacity_ * sizeof(unsigned)) ||
+            (h.records_offset_ % record_alignment != 0) || (h.records_offset_ > length_) ||
+            ((size_t)h.size_ * sizeof(record_t<T>) > length_ - h.records_offset_) )
+            return false;
+        const unsigned *table_slots = slots();
+        bool empty = false;
+        for( unsigned slot = 0; slot < h.capacity_; ++slot ) {
+            if( table_slots[slot] == empty_slot )
+                empty = true;
+            else if( table_slots[slot] >= h.size_ )
+                return false;
+        }
+        return empty;
+    }
+
+    void unmap() {
+        if( mapped_ ) munmap(const_cast<char*>(data_), length_);
+        buffer_.clear();
+        data_ = 0;
+        length_ = 0;
+        mapped_ = false;
+    }
+
+  public:
+    table_t() : data_(0), length_(0), mapped_(false) { }
+    ~table_t() { unmap(); }
+
+    bool empty() const { return data_ == 0; }
+    size_t size() const { return data_ == 0 ? 0 : header().size_; }
+    size_t capacity() const { return data_ == 0 ? 0 : header().capacity_; }
+    size_t bytes() const { return length_; }
+    std::string key() const { return data_ == 0 ? std::string() : std::string(header().key_, strnlen(header().key_, key_size)); }
+    const record_t<T>& record(size_t i) const { return records()[i]; }
+
+    // build table in memory from records
+    void build(const std::vector<record_t<T> > &records, const std::string &key) {
+        unmap();
+        unsigned capacity = 16;
+        while( capacity < 2 * records.size() ) capacity = capacity << 1;
+        size_t slots_offset = header_size;
+        size_t records_offset = slots_offset + capacity * sizeof(unsigned);
+        records_offset = (records_offset + record_alignment - 1) & ~(size_t)(record_alignment - 1);
+        size_t length = records_offset + records.size() * sizeof(record_t<T>);
+
+        buffer_.assign(length, 0);
+        header_t *header = reinterpret_cast<header_t*>(&buffer_[0]);
+        memcpy(header->magic_, magic, sizeof(magic));
+        strncpy(header->key_, key.c_str(), key_size - 1);
+        header->key_digest_ = digest(key);
+        header->state_size_ = sizeof(key_type);
+        header->record_size_ = sizeof(record_t<T>);
+        header->size_ = records.size();
+        header->capacity_ = capacity;
+        header->slots_offset_ = slots_offset;
+        header->records_offset_ = records_offset;
+
+        unsigned *slots = reinterpret_cast<unsigned*>(&buffer_[slots_offset]);
+        for( unsigned i = 0; i < capacity; ++i )
+            slots[i] = empty_slot;
+        char *base = &buffer_[records_offset];
+        for( unsigned i = 0, isz = records.size(); i < isz; ++i ) {
+            memcpy(static_cast<void*>(base + i * sizeof(record_t<T>)), static_cast<const void*>(&records[i]), sizeof(record_t<T>));
+            unsigned slot = mix(records[i].state_.hash()) & (capacity - 1);
+            while( slots[slot] != empty_slot ) slot = (1 + slot) & (capacity - 1);
+            slots[slot] = i;
+        }
+        data_ = &buffer_[0];
+        length_ = length;
+    }
+
+    // write table to file
+    bool write(const std::string &filename) const {
+        if( data_ == 0 ) return false;
+        int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if( fd == -1 ) {
+            std::cout << "error: cannot open '" << filename << "' for writing" << std::endl;
+            return false;
+        }
+        size_t written = 0;
+        while( written < length_ ) {
+            ssize_t n = ::write(fd, data_ + written, length_ - written);
+            if( n <= 0 ) break;
+            written += n;
+        }
+        close(fd);
+        if( written != length_ ) {
+            std::cout << "error: short write on '" << filename << "'" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // map table from file; key must match the one used to build the table
+    bool map(const std::string &filename, const std::string &key) {
+        unmap();
+        int fd = open(filename.c_str(), O_RDONLY);
+        if( fd == -1 ) return false;
+        struct stat sb;
+        if( (fstat(fd, &sb) == -1) || ((size_t)sb.st_size < header_size) ) {
+            close(fd);
+            return false;
+        }
+        void *addr = mmap(0, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if( addr == MAP_FAILED ) return false;
+        data_ = static_cast<const char*>(addr);
+        length_ = sb.st_size;
+        mapped_ = true;
+
+        const header_t &h = header();
+        if( (memcmp(h.magic_, magic, sizeof(magic)) != 0) ||
+            (h.state_size_ != sizeof(key_type)) ||
+            (h.record_size_ != sizeof(record_t<T>)) ) {
+            std::cout << "error: '" << filename << "' is not a valid table for this state type" << std::endl;
+            unmap();
+            return false;
+        }
+        if( !well_formed() ) {
+            std::cout << "error: '" << filename << "' is truncated or corrupt" << std::endl;
+            unmap();
+            return false;
+        }
+        if( (h.key_digest_ != digest(key)) || (strncmp(h.key_, key.c_str(), key_size - 1) != 0) ) {
+            std::cout << "error: '" << filename << "' was built for '" << std::string(h.key_, strnlen(h.key_, key_size))
+                      << (strnlen(h.key_, key_size) == key_size - 1 ? "..." : "")
+                      << "', not for '" << key << "'" << std::endl;
+            unmap();
+            return false;
+        }
+        return true;
+    }
+
+    const record_t<T>* lookup(const T &s) const {
+        if( data_ == 0 ) return 0;
+        const key_type &k = key_t<T>::make(s);
+        const unsigned *table_slots = slots();
+        const record_t<T> *table_records = records();
+        unsigned mask = header().capacity_ - 1;
+        for( unsigned slot = mix(k.hash()) & mask; table_slots[slot] != empty_slot; slot = (1 + slot) & mask ) {
+            const record_t<T> *record = &table_records[table_slots[slot]];
+            if( record->state_ == k ) return record;
+        }
+        return 0;
+    }
+
+    // batch lookup: slots for a block of states are computed and prefetched
+    // before probing, so that cache misses of different states overlap
+    void lookup(const T *const *states, size_t n, const record_t<T> **out) const {
+        if( data_ == 0 ) {
+            for( size_t i = 0; i < n; ++i ) out[i] = 0;
+            return;
+        }
+        const unsigned *table_slots = slots();
+        const record_t<T> *table_records = records();
+        unsigned mask = header().capacity_ - 1;
+        const size_t block = 16;
+        unsigned slot[block];
+        for( size_t k = 0; k < n; k += block ) {
+            size_t m = n - k < block ? n - k : block;
+            for( size_t i = 0; i < m; ++i ) {
+                slot[i] = mix(key_t<T>::make(*states[k + i]).hash()) & mask;
+                __builtin_prefetch(&table_slots[slot[i]]);
+            }
+            for( size_t i = 0; i < m; ++i ) {
+                if( table_slots[slot[i]] != empty_slot )
+                    __builtin_prefetch(&table_records[table_slots[slot[i]]]);
+            }
+            for( size_t i = 0; i < m; ++i ) {
+                const key_type &key = key_t<T>::make(*states[k + i]);
+                out[k + i] = 0;
+                for( unsigned j = slot[i]; table_slots[j] != empty_slot; j = (1 + j) & mask ) {
+                    const record_t<T> *record = &table_records[table_slots[j]];
+                    if( record->state_ == key ) {
+                        out[k + i] = record;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    void print_stats(std::ostream &os) const {
+        os << "table: key=" << key()
+           << ", #records=" << size()
+           << ", #slots=" << capacity()
+           << ", bytes=" << bytes()
+           << (mapped_ ? ", mapped" : "")
+           << std::endl;
+    }
+};
+
+}; // namespace Table
+
+#undef DEBUG
+
+#endif
+
@@ -21,6 +21,8 @@
 
 #include <iostream>
 #include <cassert>
+#include <string>
+#include <vector>
 
 #include <sys/resource.h>
 #include <sys/time.h>
@@ -56,6 +58,17 @@ template<typename T> inline T abs(const T a) {
     return a < 0 ? -a : a;
 }
 
+// split string into fields separated by sep
+inline void split(const std::string &str, char sep, std::vector<std::string> &fields) {
+    fields.clear();
+    size_t start = 0;
+    for( size_t pos = str.find(sep); pos != std::string::npos; pos = str.find(sep, start) ) {
+        fields.push_back(str.substr(start, pos - start));
+        start = 1 + pos;
+    }
+    fields.push_back(str.substr(start));
+}
+
 }; // end of namespace
 
 #undef DEBUG
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <vector>
 
 #include "race.h"
@@ -8,19 +9,25 @@
 using namespace std;
 
 void usage(ostream &os) {
-    os << "usage: race [-a <n>] [-b <n>] [-e <f>] [-f] [-g <f>] [-h <n>] [-p <f>] [-s <n>] <file>"
+    os << "usage: race [-a <n>] [-b <n>] [-c <file>] [-C <n>] [-e <f>] [-f] [-g <f>] [-h <n>] [-j <n>] [-p <f>] [-r <f>] [-s <n>] <file>"
        << endl << endl
        << "  -a <n>    Algorithm bitmask: 1=vi, 2=slrtdp, 4=ulrtdp, 8=blrtdp, 16=ilao, 32=plain-check, 64=elrtdp, 128=hdp-i, 256=hdp, 512=ldfs+, 1024=ldfs."
        << endl
        << "  -b <n>    Visits bound for blrtdp. Default: inf."
        << endl
+       << "  -c <file> Cache file for min-min heuristic (computed and saved if absent)."
+       << endl
+       << "  -C <n>    Capacity of cache of samplers for (state,action) pairs. Default: 0 (off)."
+       << endl
        << "  -e <f>    Epsilon. Default: 0."
        << endl
        << "  -f        Formatted output."
        << endl
        << "  -g <f>    Parameter for epsilon-greedy. Default: 0."
        << endl
-       << "  -h <n>    Heuristics: 0=zero, 1=minmin. Default: 0."
+       << "  -h <n>    Heuristics: 0=zero, 1=minmin, 2=lazy-minmin. Default: 0."
+       << endl
+       << "  -j <n>    Number of threads for rollout policies. Default: 1."
        << endl
 #if 0
        << "  -k <n>    Kappa consistency level. Default: 0."
@@ -30,6 +37,8 @@ void usage(ostream &os) {
 #endif
        << "  -p <f>    Parameter p in [0,1]. Default: 1."
        << endl
+       << "  -r <f>    Stop evaluation when 95% confidence half-width is <= f. Default: 0 (off)."
+       << endl
        << "  -s <n>    Random seed. Default: 0."
        << endl
        << "  <file>    Racetrack file."
@@ -41,12 +50,15 @@ int main(int argc, const char **argv) {
     float p = 1.0;
     unsigned bitmap = 0;
     int h = 0;
+    size_t sample_cache = 0;
     bool formatted = false;
     float dead_end_value = 1e3;
     float divisor = 1.0;
 
     string base_name;
     string policy_type;
+    string track_file;
+    string cache_file;
     Online::Evaluation::parameters_t eval_pars;
 
     cout << fixed;
@@ -74,6 +86,16 @@ int main(int argc, const char **argv) {
                 argv += 2;
                 argc -= 2;
                 break;
+            case 'c':
+                cache_file = argv[1];
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'C':
+                sample_cache = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
             case 'd':
                 dead_end_value = strtod(argv[1], 0);
                 argv += 2;
@@ -104,6 +126,11 @@ int main(int argc, const char **argv) {
                 argv += 2;
                 argc -= 2;
                 break;
+            case 'j':
+                eval_pars.threads_ = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
             case 'l':
                 eval_pars.labeling_ = true;
                 ++argv;
@@ -114,6 +141,11 @@ int main(int argc, const char **argv) {
                 argv += 2;
                 argc -= 2;
                 break;
+            case 'r':
+                eval_pars.evaluation_precision_ = strtod(argv[1], 0);
+                argv += 2;
+                argc -= 2;
+                break;
             case 's':
                 alg_pars.seed_ = strtoul(argv[1], 0, 0);
                 argv += 2;
@@ -131,6 +163,7 @@ int main(int argc, const char **argv) {
     }
 
     if( argc >= 3 ) {
+        track_file = argv[0];
         is = fopen(argv[0], "r");
         base_name = argv[1];
         policy_type = argv[2];
@@ -143,24 +176,41 @@ int main(int argc, const char **argv) {
         exit(-1);
     }
 
+    if( (sample_cache > 0) && (eval_pars.threads_ > 1) ) {
+        cout << "error: cache of samplers (-C) is not thread safe; cannot be used with -j" << endl;
+        exit(-1);
+    }
+
     // build problem instances
     cout << "seed=" << alg_pars.seed_ << endl;
     Random::set_seed(alg_pars.seed_);
     grid_t grid;
     grid.parse(cout, is);
     problem_t problem(grid, p);
+    problem.set_sample_cache(sample_cache);
     fclose(is);
 
     // create heuristic
     vector<pair<const Heuristic::heuristic_t<state_t>*, string> > heuristics;
     heuristics.push_back(make_pair(new Heuristic::zero_heuristic_t<state_t>, "zero"));
-    heuristics.push_back(make_pair(new Heuristic::min_min_heuristic_t<state_t>(problem, divisor), "min-min"));
+    ostringstream key;
+    key << "min-min:race(track=" << track_file << ",p=" << p << ")";
+    Heuristic::heuristic_t<state_t> *min_min =
+      new Heuristic::min_min_heuristic_t<state_t>(problem, divisor, cache_file, key.str());
+    if( !cache_file.empty() ) {
+        cout << "min-min: cache=" << cache_file << ", size=" << min_min->size()
+             << ", time=" << min_min->setup_time() << endl;
+    }
+    heuristics.push_back(make_pair(min_min, "min-min"));
+    heuristics.push_back(make_pair(new Heuristic::lazy_min_min_heuristic_t<state_t>(problem, divisor), "lazy-min-min"));
 
     Heuristic::heuristic_t<state_t> *heuristic = 0;
     if( h == 0 ) {
         heuristic = new Heuristic::zero_heuristic_t<state_t>;
     } else if( h == 1 ) {
-        heuristic = new Heuristic::min_min_heuristic_t<state_t>(problem, divisor);
+        heuristic = min_min;
+    } else if( h == 2 ) {
+        heuristic = new Heuristic::lazy_min_min_heuristic_t<state_t>(problem, divisor);
     }
 
     // solve problem with algorithms
@@ -180,8 +230,10 @@ int main(int argc, const char **argv) {
 
     // fill base policies
     const Problem::hash_t<state_t> *hash = results.empty() ? 0 : results[0].hash_;
+    Table::table_t<state_t> compiled;
     if( hash != 0 ) {
-        Online::Policy::hash_policy_t<state_t> optimal(*hash);
+        hash->compile(problem.init(), compiled, "");
+        Online::Policy::table_policy_t<state_t> optimal(problem, compiled);
         base_policies.push_back(make_pair(optimal.clone(), "optimal"));
     }
     if( heuristic != 0 ) {
@@ -206,6 +258,8 @@ int main(int argc, const char **argv) {
         cout << "error: " << policy.second << endl;
     }
 
+    if( problem.sample_cache() != 0 ) problem.sample_cache()->print_stats(cout);
+
     // free resources
     delete policy.first;
     for( unsigned i = 0; i < results.size(); ++i ) {
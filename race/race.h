@@ -1,6 +1,7 @@
 #include <cassert>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <vector>
 #include <unordered_map>
 
@@ -69,6 +70,11 @@ inline std::ostream& operator<<(std::ostream &os, const state_t &s) {
     return os;
 }
 
+// tables store states as byte images (see Table::key_t)
+namespace Table {
+template<> struct key_t<state_t> : public image_key_t<state_t> { };
+};
+
 class ecache_t : public std::unordered_map<size_t, std::pair<state_t, state_t> > { };
 //class ecache_t : public map<size_t,pair<state_t,state_t> > { };
 
@@ -82,6 +88,11 @@ class problem_t : public Problem::problem_t<state_t> {
     std::vector<state_t> goals_;
     mutable ecache_t *ecache_[9];
 
+    // striped locks for ecache_ so that next() can be called concurrently
+    // by the workers of parallel rollouts
+    enum { NUM_ECACHE_LOCKS = 64 };
+    mutable std::mutex ecache_locks_[NUM_ECACHE_LOCKS];
+
   public:
     problem_t(grid_t &grid, float p = 1.0)
       : Problem::problem_t<state_t>(DISCOUNT),
@@ -116,8 +127,23 @@ class problem_t : public Problem::problem_t<state_t> {
     virtual float cost(const state_t &s, Problem::action_t a) const {
         return terminal(s) ? 0 : 1;
     }
+    // outcome of action a in s when the action succeeds or fails (velocity unchanged)
+    state_t move(const state_t &s, Problem::action_t a, bool success) const {
+        short ox = 0, oy = 0;
+        int dx = s.dx(), dy = s.dy();
+        if( success ) {
+            dx += (a/3) - 1;
+            dy += (a%3) - 1;
+        }
+        int x = s.x() + dx, y = s.y() + dy;
+        int rv = grid_.valid_path(s.x(), s.y(), x, y, ox, oy);
+        state_t next = rv == 0 ? state_t(x, y, dx, dy) : state_t(ox, oy, 0, 0);
+        assert(grid_.valid_pos(next.x(), next.y()));
+        return next;
+    }
+
     virtual void next(const state_t &s, Problem::action_t a, std::vector<std::pair<state_t, float> > &outcomes) const {
-        ++expansions_;
+        inc_expansions();
         outcomes.clear();
         if( s == init_ ) {
             outcomes.reserve(inits_.size());
@@ -127,6 +153,7 @@ class problem_t : public Problem::problem_t<state_t> {
             outcomes.reserve(2);
             size_t off = s.x() * cols_ + s.y();
             size_t key = (((unsigned short)s.dx()) << 16) | (unsigned short)s.dy();
+            std::lock_guard<std::mutex> lock(ecache_locks_[off % NUM_ECACHE_LOCKS]);
             ecache_t::const_iterator ci = ecache_[a][off].find(key);
             if( ci != ecache_[a][off].end() ) {
                 if( p_ > 0.0 ) {
@@ -139,35 +166,34 @@ class problem_t : public Problem::problem_t<state_t> {
                 }
             } else {
                 std::pair<state_t, state_t> entry;
-                short ox = 0, oy = 0, ux = (a/3) - 1, uy = (a%3) - 1;
                 if( p_ > 0.0 ) {
-                    int dx = s.dx() + ux, dy = s.dy() + uy;
-                    int x = s.x() + dx, y = s.y() + dy;
-                    int rv = grid_.valid_path(s.x(), s.y(), x, y, ox, oy);
-                    if( rv == 0 ) {
-                        entry.first = state_t(x, y, dx, dy);
-                    } else {
-                        entry.first = state_t(ox, oy, 0, 0);
-                    }
-                    assert(grid_.valid_pos(entry.first.x(), entry.first.y()));
+                    entry.first = move(s, a, true);
                     outcomes.push_back(std::make_pair(entry.first, p_));
                 }
                 if( 1 - p_ > 0.0 ) {
-                    int dx = s.dx(), dy = s.dy();
-                    int x = s.x() + dx, y = s.y() + dy;
-                    int rv = grid_.valid_path(s.x(), s.y(), x, y, ox, oy);
-                    if( rv == 0 ) {
-                        entry.second = state_t(x, y, dx, dy);
-                    } else {
-                        entry.second = state_t(ox, oy, 0, 0);
-                    }
-                    assert(grid_.valid_pos(entry.first.x(), entry.first.y()));
+                    entry.second = move(s, a, false);
                     outcomes.push_back(std::make_pair(entry.second, 1 - p_));
                 }
                 ecache_[a][off].insert(std::make_pair(key, entry));
             }
         }
     }
+
+    // sample with a single Bernoulli draw; only the drawn outcome is
+    // computed when the transition is not cached
+    virtual std::pair<state_t, bool> sample(const state_t &s, Problem::action_t a) const {
+        if( (s == init_) || (sample_cache_ != 0) ) return Problem::problem_t<state_t>::sample(s, a);
+        bool success = Random::real() < p_;
+        size_t off = s.x() * cols_ + s.y();
+        size_t key = (((unsigned short)s.dx()) << 16) | (unsigned short)s.dy();
+        {
+            std::lock_guard<std::mutex> lock(ecache_locks_[off % NUM_ECACHE_LOCKS]);
+            ecache_t::const_iterator ci = ecache_[a][off].find(key);
+            if( ci != ecache_[a][off].end() )
+                return std::make_pair(success ? ci->second.first : ci->second.second, true);
+        }
+        return std::make_pair(move(s, a, success), true);
+    }
     virtual void print(std::ostream &os) const { }
 };
 
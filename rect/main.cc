@@ -7,7 +7,7 @@
 using namespace std;
 
 void usage(ostream &os) {
-    os << "usage: rect [-a <n>] [-b <n>] [-e <f>] [-f] [-g <f>] [-h <n>] [-p <f>] [-s <n>] <dim>"
+    os << "usage: rect [-a <n>] [-b <n>] [-e <f>] [-f] [-g <f>] [-h <n>] [-p <f>] [-r <f>] [-s <n>] [-t <n>] <dim>"
        << endl << endl
        << "  -a <n>    Algorithm bitmask: 1=vi, 2=slrtdp, 4=ulrtdp, 8=blrtdp, 16=ilao, 32=plain-check, 64=elrtdp, 128=hdp-i, 256=hdp, 512=ldfs+, 1024=ldfs."
        << endl
@@ -29,8 +29,12 @@ void usage(ostream &os) {
 #endif
        << "  -p <f>    Parameter p in [0,1]. Default: 1."
        << endl
+       << "  -r <f>    Stop evaluation when 95% confidence half-width is <= f. Default: 0 (off)."
+       << endl
        << "  -s <n>    Random seed. Default: 0."
        << endl
+       << "  -t <n>    Maximum number of evaluation trials. Default: 1000."
+       << endl
        << "  <dim>     Dimension for rows and cols <= 2^16."
        << endl << endl;
 }
@@ -91,11 +95,21 @@ int main(int argc, const char **argv) {
                 argv += 2;
                 argc -= 2;
                 break;
+            case 'r':
+                par.evaluation_precision_ = strtod(argv[1], 0);
+                argv += 2;
+                argc -= 2;
+                break;
             case 's':
                 parameters.seed_ = strtoul(argv[1], 0, 0);
                 argv += 2;
                 argc -= 2;
                 break;
+            case 't':
+                par.evaluation_trials_ = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
             default:
                 usage(cout);
                 exit(-1);
@@ -50,6 +50,11 @@ inline std::ostream& operator<<(std::ostream &os, const state_t &s) {
     return os;
 }
 
+// tables store states as byte images (see Table::key_t)
+namespace Table {
+template<> struct key_t<state_t> : public image_key_t<state_t> { };
+};
+
 class problem_t : public Problem::problem_t<state_t> {
     unsigned rows_;
     unsigned cols_;
@@ -75,7 +80,7 @@ class problem_t : public Problem::problem_t<state_t> {
         return terminal(s) ? 0 : 1;
     }
     virtual void next(const state_t &s, Problem::action_t a, std::vector<std::pair<state_t, float> > &outcomes) const {
-        ++expansions_;
+        inc_expansions();
         outcomes.clear();
         if( a != fwd ) {
             outcomes.reserve(1);
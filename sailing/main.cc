@@ -1,4 +1,5 @@
 #include <iostream>
+#include <sstream>
 #include <strings.h>
 #include <vector>
 
@@ -8,19 +9,29 @@
 using namespace std;
 
 void usage(ostream &os) {
-    os << "usage: sailing [-a <n>] [-b <n>] [-e <f>] [-f] [-g <f>] [-h <n>] [-s <n>] <dim>"
+    os << "usage: sailing [-a <n>] [-A] [-b <n>] [-c <file>] [-C <n>] [-e <f>] [-f] [-g <f>] [-h <n>] [-j <n>] [-L <file>] [-P <file>] [-r <f>] [-s <n>] [-S <file>] <dim>"
        << endl << endl
        << "  -a <n>    Algorithm bitmask: 1=vi, 2=slrtdp, 4=ulrtdp, 8=blrtdp, 16=ilao, 32=plain-check, 64=elrtdp, 128=hdp-i, 256=hdp, 512=ldfs+, 1024=ldfs."
        << endl
+       << "  -A        Antithetic trials in paired evaluation."
+       << endl
        << "  -b <n>    Visits bound for blrtdp. Default: inf."
        << endl
+       << "  -c <file> Cache file for min-min heuristic (computed and saved if absent)."
+       << endl
+       << "  -C <n>    Capacity of cache of samplers for (state,action) pairs. Default: 0 (off)."
+       << endl
        << "  -e <f>    Epsilon. Default: 0."
        << endl
        << "  -f        Formatted output."
        << endl
        << "  -g <f>    Parameter for epsilon-greedy. Default: 0."
        << endl
-       << "  -h <n>    Heuristics: 0=zero, 1=minmin. Default: 0."
+       << "  -h <n>    Heuristics: 0=zero, 1=minmin, 2=minmin-scaled, 3=lazy-minmin. Default: 0."
+       << endl
+       << "  -j <n>    Number of threads for rollout policies. Default: 1."
+       << endl
+       << "  -L <file> Load value function from table file (used as 'optimal')."
        << endl
 #if 0
        << "  -k <n>    Kappa consistency level. Default: 0."
@@ -28,9 +39,19 @@ void usage(ostream &os) {
        << "  -K <f>    Used to define kappa measures. Default: 2."
        << endl
 #endif
+       << "  -P <file> Write compiled optimal policy into table file (load with -L)."
+       << endl
+       << "  -r <f>    Stop evaluation when 95% confidence half-width is <= f. Default: 0 (off)."
+       << endl
        << "  -s <n>    Random seed. Default: 0."
        << endl
+       << "  -S <file> Save value function of first algorithm into table file."
+       << endl
        << "  <dim>     Dimension for rows ans cols <= 2^16."
+       << endl << endl
+       << "Policy types and widths may be colon-separated lists; then, all combinations"
+       << endl
+       << "are compared with paired evaluation on common random numbers."
        << endl << endl;
 }
 
@@ -39,10 +60,16 @@ int main(int argc, const char **argv) {
 
     unsigned bitmap = 0;
     int h = 0;
+    size_t sample_cache = 0;
     bool formatted = false;
 
     string base_name;
     string policy_type;
+    string load_file;
+    string save_file;
+    string policy_file;
+    string cache_file;
+    string width_list;
     Online::Evaluation::parameters_t eval_pars;
 
     cout << fixed;
@@ -59,11 +86,26 @@ int main(int argc, const char **argv) {
                 argv += 2;
                 argc -= 2;
                 break;
+            case 'A':
+                eval_pars.antithetic_ = true;
+                ++argv;
+                --argc;
+                break;
             case 'b':
                 alg_pars.rtdp.bound_ = strtol(argv[1], 0, 0);
                 argv += 2;
                 argc -= 2;
                 break;
+            case 'c':
+                cache_file = argv[1];
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'C':
+                sample_cache = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
             case 'D':
                 eval_pars.evaluation_depth_ = strtoul(argv[1], 0, 0);
                 argv += 2;
@@ -89,11 +131,36 @@ int main(int argc, const char **argv) {
                 argv += 2;
                 argc -= 2;
                 break;
+            case 'j':
+                eval_pars.threads_ = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'L':
+                load_file = argv[1];
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'P':
+                policy_file = argv[1];
+                argv += 2;
+                argc -= 2;
+                break;
+            case 'r':
+                eval_pars.evaluation_precision_ = strtod(argv[1], 0);
+                argv += 2;
+                argc -= 2;
+                break;
             case 's':
                 alg_pars.seed_ = strtoul(argv[1], 0, 0);
                 argv += 2;
                 argc -= 2;
                 break;
+            case 'S':
+                save_file = argv[1];
+                argv += 2;
+                argc -= 2;
+                break;
             case 't':
                 eval_pars.evaluation_trials_ = strtoul(argv[1], 0, 0);
                 argv += 2;
@@ -110,6 +177,7 @@ int main(int argc, const char **argv) {
         base_name = argv[1];
         policy_type = argv[2];
         if( argc >= 4 ) eval_pars.width_ = strtoul(argv[3], 0, 0);
+        if( argc >= 4 ) width_list = argv[3];
         if( argc >= 5 ) eval_pars.depth_ = strtoul(argv[4], 0, 0);
         if( argc >= 6 ) eval_pars.par1_ = strtod(argv[5], 0);
         if( argc >= 7 ) eval_pars.par2_ = strtoul(argv[6], 0, 0);
@@ -118,25 +186,42 @@ int main(int argc, const char **argv) {
         exit(-1);
     }
 
+    if( (sample_cache > 0) && (eval_pars.threads_ > 1) ) {
+        cout << "error: cache of samplers (-C) is not thread safe; cannot be used with -j" << endl;
+        exit(-1);
+    }
+
     // build problem instances
     cout << "seed=" << alg_pars.seed_ << endl;
     Random::set_seed(alg_pars.seed_);
     problem_t problem(dim, dim);
+    problem.set_sample_cache(sample_cache);
+
+    // create heuristic (a single min-min instance is shared by all uses)
+    ostringstream key;
+    key << "sailing(dim=" << dim << ")";
+    Heuristic::heuristic_t<state_t> *min_min =
+      new Heuristic::min_min_heuristic_t<state_t>(problem, 1.0, cache_file, "min-min:" + key.str());
+    if( !cache_file.empty() ) {
+        cout << "min-min: cache=" << cache_file << ", size=" << min_min->size()
+             << ", time=" << min_min->setup_time() << endl;
+    }
 
-    // create heuristic
     vector<pair<const Heuristic::heuristic_t<state_t>*, string> > heuristics;
     heuristics.push_back(make_pair(new zero_heuristic_t, "zero"));
-    heuristics.push_back(make_pair(new Heuristic::min_min_heuristic_t<state_t>(problem), "min-min"));
-    heuristics.push_back(make_pair(new scaled_heuristic_t(new Heuristic::min_min_heuristic_t<state_t>(problem), 0.5), "min-min-scaled"));
+    heuristics.push_back(make_pair(min_min, "min-min"));
+    heuristics.push_back(make_pair(new scaled_heuristic_t(min_min, 0.5), "min-min-scaled"));
+    heuristics.push_back(make_pair(new Heuristic::lazy_min_min_heuristic_t<state_t>(problem), "lazy-min-min"));
 
     Heuristic::heuristic_t<state_t> *heuristic = 0;
     if( h == 0 ) {
         heuristic = new zero_heuristic_t;
     } else if( h == 1 ) {
-        heuristic = new Heuristic::min_min_heuristic_t<state_t>(problem);
+        heuristic = min_min;
     } else if( h == 2 ) {
-        Heuristic::heuristic_t<state_t> *base = new Heuristic::min_min_heuristic_t<state_t>(problem);
-        heuristic = new scaled_heuristic_t(base, 0.5);
+        heuristic = new scaled_heuristic_t(min_min, 0.5);
+    } else if( h == 3 ) {
+        heuristic = new Heuristic::lazy_min_min_heuristic_t<state_t>(problem);
     }
 
     // solve problem with algorithms
@@ -151,13 +236,39 @@ int main(int argc, const char **argv) {
         }
     }
 
+    // save value function of first algorithm, or load it from file
+    if( !save_file.empty() && !results.empty() ) {
+        if( !results[0].hash_->save(save_file, key.str()) ) exit(-1);
+        cout << "table: saved " << results[0].hash_->size() << " states into '" << save_file << "'" << endl;
+    }
+    Table::table_t<state_t> table;
+    if( !load_file.empty() ) {
+        float start_time = Utils::read_time_in_seconds();
+        if( !table.map(load_file, key.str()) ) {
+            cout << "error: cannot load table from '" << load_file << "'" << endl;
+            exit(-1);
+        }
+        table.print_stats(cout);
+        cout << "table: load-time=" << Utils::read_time_in_seconds() - start_time << endl;
+        heuristics.push_back(make_pair(new Heuristic::table_heuristic_t<state_t>(table), "optimal"));
+    }
+
     // evaluate policies
     vector<pair<const Online::Policy::policy_t<state_t>*, string> > bases;
 
     // fill base policies
     const Problem::hash_t<state_t> *hash = results.empty() ? 0 : results[0].hash_;
+    Table::table_t<state_t> compiled;
     if( hash != 0 ) {
-        Online::Policy::hash_policy_t<state_t> optimal(*hash);
+        float start_time = Utils::read_time_in_seconds();
+        hash->compile(problem.init(), compiled, key.str());
+        cout << "compiled: #records=" << compiled.size()
+             << ", time=" << Utils::read_time_in_seconds() - start_time << endl;
+        if( !policy_file.empty() && !compiled.write(policy_file) ) exit(-1);
+        Online::Policy::table_policy_t<state_t> optimal(problem, compiled);
+        bases.push_back(make_pair(optimal.clone(), "optimal"));
+    } else if( !table.empty() ) {
+        Online::Policy::table_policy_t<state_t> optimal(problem, table);
         bases.push_back(make_pair(optimal.clone(), "optimal"));
     }
     if( heuristic != 0 ) {
@@ -171,6 +282,41 @@ int main(int argc, const char **argv) {
     Online::Policy::random_t<state_t> random(problem);
     bases.push_back(make_pair(&random, "random"));
 
+    // paired evaluation of several policy types and/or widths
+    vector<string> policy_types, widths;
+    Utils::split(policy_type, ':', policy_types);
+    Utils::split(width_list, ':', widths);
+    if( (policy_types.size() > 1) || (widths.size() > 1) ) {
+        vector<const Online::Policy::policy_t<state_t>*> policies;
+        vector<string> names;
+        for( size_t i = 0; i < policy_types.size(); ++i ) {
+            for( size_t j = 0; j < widths.size(); ++j ) {
+                Online::Evaluation::parameters_t pars = eval_pars;
+                pars.width_ = strtoul(widths[j].c_str(), 0, 0);
+                pair<const Online::Policy::policy_t<state_t>*, std::string> policy =
+                  Online::Evaluation::select_policy(problem, base_name, policy_types[i], bases, heuristics, pars);
+                if( policy.first == 0 ) {
+                    cout << "error: " << policy.second << endl;
+                    exit(-1);
+                }
+                policies.push_back(policy.first);
+                names.push_back(policy.second);
+            }
+        }
+        Online::Evaluation::paired_stats_t stats;
+        float time = Online::Evaluation::evaluate_policies(policies, eval_pars, stats, true);
+        Online::Evaluation::print_paired_stats(cout, names, stats, eval_pars.antithetic_, time);
+        for( size_t i = 0; i < policies.size(); ++i ) {
+            policies[i]->print_stats(cout);
+            delete policies[i];
+        }
+        for( unsigned i = 0; i < results.size(); ++i ) {
+            delete results[i].hash_;
+        }
+        delete heuristic;
+        exit(0);
+    }
+
     // evaluate
     pair<const Online::Policy::policy_t<state_t>*, std::string> policy =
       Online::Evaluation::select_policy(problem, base_name, policy_type, bases, heuristics, eval_pars);
@@ -185,6 +331,8 @@ int main(int argc, const char **argv) {
         cout << "error: " << policy.second << endl;
     }
 
+    if( problem.sample_cache() != 0 ) problem.sample_cache()->print_stats(cout);
+
     // free resources
     delete policy.first;
     for( unsigned i = 0; i < results.size(); ++i ) {
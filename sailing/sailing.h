@@ -77,10 +77,16 @@ inline std::ostream& operator<<(std::ostream &os, const state_t &s) {
     return os;
 }
 
+// tables store states as byte images (see Table::key_t)
+namespace Table {
+template<> struct key_t<state_t> : public image_key_t<state_t> { };
+};
+
 class problem_t : public Problem::problem_t<state_t> {
     int rows_;
     int cols_;
     float wind_transition_[64];
+    float wind_cdf_[64];
     float costs_[5];
     state_t init_;
     state_t goal_;
@@ -108,6 +114,21 @@ class problem_t : public Problem::problem_t<state_t> {
             bcopy(default_wind_transition_, wind_transition_, 64 * sizeof(float));
         }
 
+        // cumulative wind distributions; entries from the last wind with
+        // positive probability are set to max so that sample() never
+        // returns a wind with zero probability because of rounding
+        for( int wind = 0; wind < 8; ++wind ) {
+            float mass = 0;
+            int last = 0;
+            for( int nwind = 0; nwind < 8; ++nwind ) {
+                mass += wind_transition_[wind * 8 + nwind];
+                wind_cdf_[wind * 8 + nwind] = mass;
+                if( wind_transition_[wind * 8 + nwind] > 0 ) last = nwind;
+            }
+            for( int nwind = last; nwind < 8; ++nwind )
+                wind_cdf_[wind * 8 + nwind] = std::numeric_limits<float>::max();
+        }
+
         if( costs != 0 ) {
             bcopy(costs, costs_, 5 * sizeof(float));
         } else {
@@ -129,7 +150,7 @@ class problem_t : public Problem::problem_t<state_t> {
         return terminal(s) ? 0 : costs_[s.tack(a)];
     }
     virtual void next(const state_t &s, Problem::action_t a, std::vector<std::pair<state_t,float> > &outcomes) const {
-        ++expansions_;
+        inc_expansions();
         outcomes.clear();
         outcomes.reserve(8);
         state_t next_s = s.apply(a);
@@ -142,6 +163,20 @@ class problem_t : public Problem::problem_t<state_t> {
             }
         }
     }
+    virtual std::pair<state_t, bool> sample(const state_t &s, Problem::action_t a) const {
+        if( sample_cache_ != 0 ) return Problem::problem_t<state_t>::sample(s, a);
+
+        // draw next wind with the cumulative distribution of the row of
+        // current wind; the count is branch free
+        state_t next_s = s.apply(a);
+        assert(next_s.in_lake(rows_, cols_));
+        const float *cdf = &wind_cdf_[s.wind_ * 8];
+        float r = Random::real();
+        int nwind = 0;
+        for( int i = 0; i < 7; ++i ) nwind += r >= cdf[i];
+        next_s.wind_ = nwind;
+        return std::make_pair(next_s, true);
+    }
     virtual void print(std::ostream &os) const { }
 };
 
@@ -8,7 +8,7 @@
 using namespace std;
 
 void usage(ostream &os) {
-    os << "usage: wet [-a <n>] [-b <n>] [-e <f>] [-g <f>] [-h <n>] [-p <f>] [-s <n>] [-X] [-Y|-Z] <size>"
+    os << "usage: wet [-a <n>] [-b <n>] [-C <n>] [-e <f>] [-g <f>] [-h <n>] [-p <f>] [-s <n>] [-X] [-Y|-Z] <size>"
        << endl;
 }
 
@@ -18,6 +18,7 @@ int main(int argc, const char **argv) {
     float p = 0.0;
     unsigned bitmap = 0;
     int h = 0;
+    size_t sample_cache = 0;
     bool formatted = false;
 
     string base_name;
@@ -43,6 +44,11 @@ int main(int argc, const char **argv) {
                 argv += 2;
                 argc -= 2;
                 break;
+            case 'C':
+                sample_cache = strtoul(argv[1], 0, 0);
+                argv += 2;
+                argc -= 2;
+                break;
             case 'e':
                 parameters.epsilon_ = strtod(argv[1], 0);
                 argv += 2;
@@ -109,6 +115,7 @@ int main(int argc, const char **argv) {
     state_t init(Random::uniform(size), Random::uniform(size));
     state_t goal(Random::uniform(size), Random::uniform(size));
     problem_t problem(size, p, init, goal);
+    problem.set_sample_cache(sample_cache);
     //problem.print(cout);
 
     // create heuristic
@@ -151,6 +158,8 @@ int main(int argc, const char **argv) {
     pair<pair<float, float>, float> eval = Online::Evaluation::evaluate_policy(*policy.first, par);
     cout << setprecision(5) << eval.first.first << " " << eval.first.second << setprecision(2) << " ( " << eval.second << " secs)" << endl;
 
+    if( problem.sample_cache() != 0 ) problem.sample_cache()->print_stats(cout);
+
     // free resources
     delete policy.first;
     for( unsigned i = 0; i < results.size(); ++i ) {